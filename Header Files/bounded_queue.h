@@ -0,0 +1,145 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+
+// Fixed-capacity multi-producer multi-consumer queue without locks. Every
+// cell carries a sequence number that tells producers and consumers whose
+// turn it is, so a push or pop is one compare-and-swap on the shared index
+// plus a store to the cell. Capacity is rounded up to a power of two.
+template <typename T>
+class BoundedQueue {
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::vector<Cell> cells;
+    size_t mask;
+
+    // Producer and consumer indices live on separate cache lines so the two
+    // sides do not invalidate each other on every operation.
+    alignas(64) std::atomic<size_t> enqueue_index;
+    alignas(64) std::atomic<size_t> dequeue_index;
+    alignas(64) std::atomic<bool> closed;
+
+
+    // Yields for a while, then sleeps, so a stage waiting on a slow
+    // neighbour does not take CPU time away from it.
+    static void backOff(unsigned int& attempts) {
+        if (++attempts < 64) {
+            std::this_thread::yield();
+        }
+        else {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+
+public:
+    explicit BoundedQueue(size_t capacity) : enqueue_index(0), dequeue_index(0), closed(false) {
+        size_t size = 2;
+        while (size < capacity) {
+            size *= 2;
+        }
+
+        cells = std::vector<Cell>(size);
+        mask = size - 1;
+        for (size_t i = 0; i < size; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+
+    // Returns false without waiting when the queue is full.
+    bool tryPush(T& value) {
+        size_t position = enqueue_index.load(std::memory_order_relaxed);
+
+        while (true) {
+            Cell& cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+            if (difference == 0) {
+                if (enqueue_index.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0) {
+                return false;
+            }
+            else {
+                position = enqueue_index.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+
+    // Returns false without waiting when the queue is empty.
+    bool tryPop(T& value) {
+        size_t position = dequeue_index.load(std::memory_order_relaxed);
+
+        while (true) {
+            Cell& cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+
+            if (difference == 0) {
+                if (dequeue_index.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.value);
+                    cell.sequence.store(position + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0) {
+                return false;
+            }
+            else {
+                position = dequeue_index.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+
+    // Waits for a free cell. Stages hand over whole images, so backing off
+    // between attempts costs nothing measurable.
+    void push(T&& value) {
+        unsigned int attempts = 0;
+        while (!tryPush(value)) {
+            backOff(attempts);
+        }
+    }
+
+
+    // Waits for an item. Returns false once the queue is closed and drained.
+    bool pop(T& value) {
+        unsigned int attempts = 0;
+        while (!tryPop(value)) {
+            if (closed.load(std::memory_order_acquire)) {
+                return tryPop(value);
+            }
+            backOff(attempts);
+        }
+        return true;
+    }
+
+
+    // Called by the last producer: consumers finish what is queued and stop.
+    void close() {
+        closed.store(true, std::memory_order_release);
+    }
+};
+
+#endif
@@ -0,0 +1,988 @@
+#ifndef CONVOLUTION_H
+#define CONVOLUTION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "cpu_features.h"
+#include "pixel_layout.h"
+
+// Separable convolution on interleaved 8-bit images. A 2D kernel that is the
+// product of a horizontal and a vertical 1D kernel (Gaussian, box) is applied
+// as two 1D passes, so a (2r+1)^2 kernel costs 2(2r+1) multiply-adds per
+// channel instead of (2r+1)^2.
+//
+// The image is cut into tiles. For each tile the horizontal pass filters the
+// rows it needs, including r rows of halo above and below, into a float
+// scratch block that fits in L2; the vertical pass then sums those rows into
+// one output row at a time. Both passes are the same weighted sum
+//     out[i] = sum over k of taps[k] * in[i + k * step]
+// over contiguous interleaved floats, which is the only vectorized kernel.
+// The scalar, SSE2 and AVX2 variants produce identical floats; AVX-512 uses
+// fused multiply-add, which can differ in the last bit of a float but
+// practically never in the 8-bit result.
+
+
+// How pixels outside the image are read.
+enum class BorderMode {
+    Clamp,      // repeat the edge pixel
+    Mirror,     // reflect around the edge pixel: -1 reads 1
+    Wrap        // tile the image: -1 reads width - 1
+};
+
+
+inline const char* borderModeName(BorderMode mode) {
+    switch (mode) {
+        case BorderMode::Mirror: return "mirror";
+        case BorderMode::Wrap: return "wrap";
+        default: return "clamp";
+    }
+}
+
+
+// Maps a coordinate that may lie outside [0, size) back into the image.
+inline int borderIndex(int index, int size, BorderMode mode) {
+    if (index >= 0 && index < size) return index;
+
+    switch (mode) {
+        case BorderMode::Mirror: {
+            if (size == 1) return 0;
+            int period = 2 * (size - 1);
+            index %= period;
+            if (index < 0) index += period;
+            return (index < size) ? index : period - index;
+        }
+        case BorderMode::Wrap:
+            index %= size;
+            return (index < 0) ? index + size : index;
+        default:
+            return std::min(std::max(index, 0), size - 1);
+    }
+}
+
+
+// Normalized Gaussian taps for offsets -radius..radius. The radius covers
+// three standard deviations, which keeps all but 0.3% of the weight.
+inline std::vector<float> gaussianTaps(double radius) {
+    int tap_radius = std::max(1, static_cast<int>(std::ceil(radius)));
+    double sigma = std::max(radius, 0.5) / 3.0;
+
+    std::vector<float> taps(2 * tap_radius + 1);
+    double sum = 0.0;
+    for (int i = -tap_radius; i <= tap_radius; i++) {
+        double weight = std::exp(-(i * i) / (2.0 * sigma * sigma));
+        taps[i + tap_radius] = static_cast<float>(weight);
+        sum += weight;
+    }
+    for (float& tap : taps) {
+        tap = static_cast<float>(tap / sum);
+    }
+    return taps;
+}
+
+
+// out[i] = sum over k of taps[k] * in[i + k * step], for i in [0, count).
+// The horizontal pass steps by one pixel through a padded row, the vertical
+// pass by one row through the filtered rows.
+inline void weightedSumScalar(float* out, const float* in, size_t step, const float* taps, size_t tap_count,
+                              size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        float sum = 0.0f;
+        for (size_t k = 0; k < tap_count; k++) {
+            sum += taps[k] * in[i + k * step];
+        }
+        out[i] = sum;
+    }
+}
+
+
+#ifdef MORPH_X86
+
+// Each vector kernel keeps four independent sums in registers, so the adds
+// of consecutive taps overlap, and stores every output once. It returns
+// how many leading elements it handled; the scalar kernel does the rest.
+
+MORPH_TARGET_SSE2
+inline size_t weightedSumSSE2(float* out, const float* in, size_t step, const float* taps, size_t tap_count,
+                              size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps(), s2 = _mm_setzero_ps(), s3 = _mm_setzero_ps();
+        for (size_t k = 0; k < tap_count; k++) {
+            const float* p = in + i + k * step;
+            const __m128 w = _mm_set1_ps(taps[k]);
+            s0 = _mm_add_ps(s0, _mm_mul_ps(w, _mm_loadu_ps(p)));
+            s1 = _mm_add_ps(s1, _mm_mul_ps(w, _mm_loadu_ps(p + 4)));
+            s2 = _mm_add_ps(s2, _mm_mul_ps(w, _mm_loadu_ps(p + 8)));
+            s3 = _mm_add_ps(s3, _mm_mul_ps(w, _mm_loadu_ps(p + 12)));
+        }
+        _mm_storeu_ps(out + i, s0);
+        _mm_storeu_ps(out + i + 4, s1);
+        _mm_storeu_ps(out + i + 8, s2);
+        _mm_storeu_ps(out + i + 12, s3);
+    }
+    return i;
+}
+
+
+MORPH_TARGET_AVX2
+inline size_t weightedSumAVX2(float* out, const float* in, size_t step, const float* taps, size_t tap_count,
+                              size_t count) {
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps(), s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+        for (size_t k = 0; k < tap_count; k++) {
+            const float* p = in + i + k * step;
+            const __m256 w = _mm256_set1_ps(taps[k]);
+            s0 = _mm256_add_ps(s0, _mm256_mul_ps(w, _mm256_loadu_ps(p)));
+            s1 = _mm256_add_ps(s1, _mm256_mul_ps(w, _mm256_loadu_ps(p + 8)));
+            s2 = _mm256_add_ps(s2, _mm256_mul_ps(w, _mm256_loadu_ps(p + 16)));
+            s3 = _mm256_add_ps(s3, _mm256_mul_ps(w, _mm256_loadu_ps(p + 24)));
+        }
+        _mm256_storeu_ps(out + i, s0);
+        _mm256_storeu_ps(out + i + 8, s1);
+        _mm256_storeu_ps(out + i + 16, s2);
+        _mm256_storeu_ps(out + i + 24, s3);
+    }
+    return i;
+}
+
+
+MORPH_TARGET_AVX512
+inline size_t weightedSumAVX512(float* out, const float* in, size_t step, const float* taps, size_t tap_count,
+                                size_t count) {
+    size_t i = 0;
+    for (; i + 64 <= count; i += 64) {
+        __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps(), s2 = _mm512_setzero_ps(), s3 = _mm512_setzero_ps();
+        for (size_t k = 0; k < tap_count; k++) {
+            const float* p = in + i + k * step;
+            const __m512 w = _mm512_set1_ps(taps[k]);
+            s0 = _mm512_fmadd_ps(w, _mm512_loadu_ps(p), s0);
+            s1 = _mm512_fmadd_ps(w, _mm512_loadu_ps(p + 16), s1);
+            s2 = _mm512_fmadd_ps(w, _mm512_loadu_ps(p + 32), s2);
+            s3 = _mm512_fmadd_ps(w, _mm512_loadu_ps(p + 48), s3);
+        }
+        _mm512_storeu_ps(out + i, s0);
+        _mm512_storeu_ps(out + i + 16, s1);
+        _mm512_storeu_ps(out + i + 32, s2);
+        _mm512_storeu_ps(out + i + 48, s3);
+    }
+    return i;
+}
+
+#endif
+
+
+inline void weightedSum(float* out, const float* in, size_t step, const std::vector<float>& taps, size_t count,
+                        SimdLevel level) {
+    size_t done = 0;
+
+#ifdef MORPH_X86
+    switch (level) {
+        case SimdLevel::AVX512: done = weightedSumAVX512(out, in, step, taps.data(), taps.size(), count); break;
+        case SimdLevel::AVX2: done = weightedSumAVX2(out, in, step, taps.data(), taps.size(), count); break;
+        case SimdLevel::SSE2: done = weightedSumSSE2(out, in, step, taps.data(), taps.size(), count); break;
+        default: break;
+    }
+#else
+    (void)level;
+#endif
+
+    weightedSumScalar(out + done, in + done, step, taps.data(), taps.size(), count - done);
+}
+
+
+// Converts count bytes to floats.
+inline void widenBytesScalar(float* out, const unsigned char* in, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = in[i];
+    }
+}
+
+
+// Turns filtered floats back into bytes, blended with the source:
+//     target = round(clamp(source_weight * in + filtered_weight * filtered, 0, 255))
+//     out    = (in * (256 - blend) + target * blend + 128) >> 8
+// A blur uses weights (0, 1); an unsharp mask with gain s uses (1 + s, -s).
+// The blend is integer math on values below 2^24, which floats hold
+// exactly, so the vector kernels do it in float lanes.
+inline void blendFilteredScalar(unsigned char* out, const unsigned char* in, const float* filtered, size_t count,
+                                float source_weight, float filtered_weight, int blend) {
+    const int keep = 256 - blend;
+    for (size_t i = 0; i < count; i++) {
+        float value = source_weight * in[i] + filtered_weight * filtered[i];
+        int target = static_cast<int>(std::min(255.0f, std::max(0.0f, value)) + 0.5f);
+        out[i] = static_cast<unsigned char>((in[i] * keep + target * blend + 128) >> 8);
+    }
+}
+
+
+#ifdef MORPH_X86
+
+MORPH_TARGET_SSE2
+inline size_t widenBytesSSE2(float* out, const unsigned char* in, size_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+        __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+        _mm_storeu_ps(out + i, _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)));
+        _mm_storeu_ps(out + i + 4, _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)));
+        _mm_storeu_ps(out + i + 8, _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)));
+        _mm_storeu_ps(out + i + 12, _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)));
+    }
+    return i;
+}
+
+
+MORPH_TARGET_SSE2
+inline __m128i blendFilteredSSE2(__m128i in, __m128 filtered, __m128 source_weight, __m128 filtered_weight,
+                                 __m128 keep, __m128 blend) {
+    const __m128 source = _mm_cvtepi32_ps(in);
+    __m128 value = _mm_add_ps(_mm_mul_ps(source_weight, source), _mm_mul_ps(filtered_weight, filtered));
+    value = _mm_min_ps(_mm_set1_ps(255.0f), _mm_max_ps(_mm_setzero_ps(), value));
+    __m128 target = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_add_ps(value, _mm_set1_ps(0.5f))));
+    __m128 mixed = _mm_add_ps(_mm_add_ps(_mm_mul_ps(source, keep), _mm_mul_ps(target, blend)), _mm_set1_ps(128.0f));
+    return _mm_cvttps_epi32(_mm_mul_ps(mixed, _mm_set1_ps(1.0f / 256.0f)));
+}
+
+
+MORPH_TARGET_SSE2
+inline size_t blendFilteredSSE2(unsigned char* out, const unsigned char* in, const float* filtered, size_t count,
+                                float source_weight, float filtered_weight, int blend) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 sw = _mm_set1_ps(source_weight);
+    const __m128 fw = _mm_set1_ps(filtered_weight);
+    const __m128 keep = _mm_set1_ps(static_cast<float>(256 - blend));
+    const __m128 mix = _mm_set1_ps(static_cast<float>(blend));
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+        __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+
+        __m128i r0 = blendFilteredSSE2(_mm_unpacklo_epi16(lo, zero), _mm_loadu_ps(filtered + i), sw, fw, keep, mix);
+        __m128i r1 = blendFilteredSSE2(_mm_unpackhi_epi16(lo, zero), _mm_loadu_ps(filtered + i + 4), sw, fw, keep, mix);
+        __m128i r2 = blendFilteredSSE2(_mm_unpacklo_epi16(hi, zero), _mm_loadu_ps(filtered + i + 8), sw, fw, keep, mix);
+        __m128i r3 = blendFilteredSSE2(_mm_unpackhi_epi16(hi, zero), _mm_loadu_ps(filtered + i + 12), sw, fw, keep, mix);
+
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(r0, r1), _mm_packs_epi32(r2, r3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+    }
+    return i;
+}
+
+
+MORPH_TARGET_AVX2
+inline size_t widenBytesAVX2(float* out, const unsigned char* in, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm256_storeu_ps(out + i, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes)));
+        _mm256_storeu_ps(out + i + 8, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8))));
+    }
+    return i;
+}
+
+
+MORPH_TARGET_AVX2
+inline __m256i blendFilteredAVX2(__m128i bytes, __m256 filtered, __m256 source_weight, __m256 filtered_weight,
+                                 __m256 keep, __m256 blend) {
+    const __m256 source = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+    __m256 value = _mm256_add_ps(_mm256_mul_ps(source_weight, source), _mm256_mul_ps(filtered_weight, filtered));
+    value = _mm256_min_ps(_mm256_set1_ps(255.0f), _mm256_max_ps(_mm256_setzero_ps(), value));
+    __m256 target = _mm256_cvtepi32_ps(_mm256_cvttps_epi32(_mm256_add_ps(value, _mm256_set1_ps(0.5f))));
+    __m256 mixed = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(source, keep), _mm256_mul_ps(target, blend)),
+                                 _mm256_set1_ps(128.0f));
+    return _mm256_cvttps_epi32(_mm256_mul_ps(mixed, _mm256_set1_ps(1.0f / 256.0f)));
+}
+
+
+MORPH_TARGET_AVX2
+inline size_t blendFilteredAVX2(unsigned char* out, const unsigned char* in, const float* filtered, size_t count,
+                                float source_weight, float filtered_weight, int blend) {
+    const __m256 sw = _mm256_set1_ps(source_weight);
+    const __m256 fw = _mm256_set1_ps(filtered_weight);
+    const __m256 keep = _mm256_set1_ps(static_cast<float>(256 - blend));
+    const __m256 mix = _mm256_set1_ps(static_cast<float>(blend));
+    // Packing works per 128-bit lane; this puts the four 32-bit groups back
+    // in order.
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        __m128i lo = _mm256_castsi256_si128(bytes);
+        __m128i hi = _mm256_extracti128_si256(bytes, 1);
+
+        __m256i r0 = blendFilteredAVX2(lo, _mm256_loadu_ps(filtered + i), sw, fw, keep, mix);
+        __m256i r1 = blendFilteredAVX2(_mm_srli_si128(lo, 8), _mm256_loadu_ps(filtered + i + 8), sw, fw, keep, mix);
+        __m256i r2 = blendFilteredAVX2(hi, _mm256_loadu_ps(filtered + i + 16), sw, fw, keep, mix);
+        __m256i r3 = blendFilteredAVX2(_mm_srli_si128(hi, 8), _mm256_loadu_ps(filtered + i + 24), sw, fw, keep, mix);
+
+        __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(r0, r1), _mm256_packs_epi32(r2, r3));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_permutevar8x32_epi32(packed, order));
+    }
+    return i;
+}
+
+
+MORPH_TARGET_AVX512
+inline size_t widenBytesAVX512(float* out, const unsigned char* in, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm512_storeu_ps(out + i, _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(bytes)));
+    }
+    return i;
+}
+
+
+MORPH_TARGET_AVX512
+inline size_t blendFilteredAVX512(unsigned char* out, const unsigned char* in, const float* filtered, size_t count,
+                                  float source_weight, float filtered_weight, int blend) {
+    const __m512 sw = _mm512_set1_ps(source_weight);
+    const __m512 fw = _mm512_set1_ps(filtered_weight);
+    const __m512 keep = _mm512_set1_ps(static_cast<float>(256 - blend));
+    const __m512 mix = _mm512_set1_ps(static_cast<float>(blend));
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        const __m512 source = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(bytes));
+        __m512 value = _mm512_add_ps(_mm512_mul_ps(sw, source), _mm512_mul_ps(fw, _mm512_loadu_ps(filtered + i)));
+        value = _mm512_min_ps(_mm512_set1_ps(255.0f), _mm512_max_ps(_mm512_setzero_ps(), value));
+        __m512 target = _mm512_cvtepi32_ps(_mm512_cvttps_epi32(_mm512_add_ps(value, _mm512_set1_ps(0.5f))));
+        __m512 mixed = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(source, keep), _mm512_mul_ps(target, mix)),
+                                     _mm512_set1_ps(128.0f));
+        __m512i result = _mm512_cvttps_epi32(_mm512_mul_ps(mixed, _mm512_set1_ps(1.0f / 256.0f)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm512_cvtepi32_epi8(result));
+    }
+    return i;
+}
+
+#endif
+
+
+inline void widenBytes(float* out, const unsigned char* in, size_t count, SimdLevel level) {
+    size_t done = 0;
+
+#ifdef MORPH_X86
+    switch (level) {
+        case SimdLevel::AVX512: done = widenBytesAVX512(out, in, count); break;
+        case SimdLevel::AVX2: done = widenBytesAVX2(out, in, count); break;
+        case SimdLevel::SSE2: done = widenBytesSSE2(out, in, count); break;
+        default: break;
+    }
+#else
+    (void)level;
+#endif
+
+    widenBytesScalar(out + done, in + done, count - done);
+}
+
+
+inline void blendFiltered(unsigned char* out, const unsigned char* in, const float* filtered, size_t count,
+                          float source_weight, float filtered_weight, int blend, SimdLevel level) {
+    size_t done = 0;
+
+#ifdef MORPH_X86
+    switch (level) {
+        case SimdLevel::AVX512:
+            done = blendFilteredAVX512(out, in, filtered, count, source_weight, filtered_weight, blend);
+            break;
+        case SimdLevel::AVX2:
+            done = blendFilteredAVX2(out, in, filtered, count, source_weight, filtered_weight, blend);
+            break;
+        case SimdLevel::SSE2:
+            done = blendFilteredSSE2(out, in, filtered, count, source_weight, filtered_weight, blend);
+            break;
+        default:
+            break;
+    }
+#else
+    (void)level;
+#endif
+
+    blendFilteredScalar(out + done, in + done, filtered + done, count - done, source_weight, filtered_weight, blend);
+}
+
+
+// A rectangle of output pixels, computed by one task.
+struct ConvolutionTile {
+    int first_row;
+    int row_count;
+    int first_column;
+    int column_count;
+};
+
+
+// Target size of one tile's float scratch block.
+const size_t CONVOLUTION_TILE_BYTES = 512 * 1024;
+
+
+// Cuts the image into tiles for a kernel of the given radius. Tiles are at
+// least 4 radii tall so the halo rows add at most half to the horizontal
+// pass, and as wide as the scratch budget allows.
+inline std::vector<ConvolutionTile> planConvolutionTiles(int width, int height, int channels, int radius) {
+    int tile_rows = std::min(height, std::max(64, 4 * radius));
+    size_t row_floats = static_cast<size_t>(tile_rows + 2 * radius) * channels;
+    int tile_columns = static_cast<int>(std::min<size_t>(
+        width, std::max<size_t>(32, CONVOLUTION_TILE_BYTES / (row_floats * sizeof(float)))));
+
+    std::vector<ConvolutionTile> tiles;
+    for (int row = 0; row < height; row += tile_rows) {
+        for (int column = 0; column < width; column += tile_columns) {
+            tiles.push_back({row, std::min(tile_rows, height - row), column, std::min(tile_columns, width - column)});
+        }
+    }
+    return tiles;
+}
+
+
+// Convolves one tile of src with taps (2r+1 weights, used for both passes)
+// and calls store(row, filtered) for each of the tile's rows, where filtered
+// holds column_count * channels floats starting at the tile's first column.
+// Only reads src, so tiles can run concurrently as long as store writes to
+// a different buffer.
+template <typename StoreFn>
+void convolveTile(const unsigned char* src, int width, int height, int channels, const std::vector<float>& taps,
+                  BorderMode border, const ConvolutionTile& tile, StoreFn&& store,
+                  SimdLevel level = simdLevel()) {
+    const int radius = static_cast<int>(taps.size() / 2);
+    const size_t row_floats = static_cast<size_t>(tile.column_count) * channels;
+    const int padded_columns = tile.column_count + 2 * radius;
+    const int halo_rows = tile.row_count + 2 * radius;
+
+    // Reused across tiles on the same thread: padded source row, the
+    // horizontally filtered rows, and one output row.
+    static thread_local std::vector<float> scratch;
+    scratch.resize(static_cast<size_t>(padded_columns) * channels + (halo_rows + 1) * row_floats);
+    float* padded = scratch.data();
+    float* filtered_rows = padded + static_cast<size_t>(padded_columns) * channels;
+    float* filtered = filtered_rows + halo_rows * row_floats;
+
+    // Padded columns [inside_start, inside_end) lie inside the image and
+    // convert as one contiguous run; only the columns outside are remapped.
+    const int first_padded = tile.first_column - radius;
+    const int inside_start = std::min(padded_columns, std::max(0, -first_padded));
+    const int inside_end = std::max(inside_start, std::min(padded_columns, width - first_padded));
+    const size_t inside_floats = static_cast<size_t>(inside_end - inside_start) * channels;
+
+    static thread_local std::vector<size_t> column_offsets;
+    column_offsets.resize(padded_columns);
+    for (int i = 0; i < padded_columns; i++) {
+        column_offsets[i] = static_cast<size_t>(borderIndex(first_padded + i, width, border)) * channels;
+    }
+
+    const size_t stride = static_cast<size_t>(width) * channels;
+
+    for (int i = 0; i < halo_rows; i++) {
+        const unsigned char* row = src + borderIndex(tile.first_row - radius + i, height, border) * stride;
+
+        widenBytes(padded + static_cast<size_t>(inside_start) * channels,
+                   row + static_cast<size_t>(first_padded + inside_start) * channels, inside_floats, level);
+
+        for (int column = 0; column < padded_columns; column++) {
+            if (column == inside_start) column = inside_end;
+            if (column >= padded_columns) break;
+
+            const unsigned char* pixel = row + column_offsets[column];
+            float* p = padded + static_cast<size_t>(column) * channels;
+            for (int c = 0; c < channels; c++) {
+                p[c] = pixel[c];
+            }
+        }
+
+        weightedSum(filtered_rows + i * row_floats, padded, channels, taps, row_floats, level);
+    }
+
+    for (int i = 0; i < tile.row_count; i++) {
+        weightedSum(filtered, filtered_rows + i * row_floats, row_floats, taps, row_floats, level);
+        store(tile.first_row + i, static_cast<const float*>(filtered));
+    }
+}
+
+
+// Box filters by running sums
+//
+// Direct convolution costs 2(2r+1) multiply-adds per channel, so a radius 200
+// blur is a hundred times a radius 2 one. A box filter can instead keep a
+// running sum along each axis: add the sample entering the window, subtract
+// the one leaving it. Each box then costs the same per pixel at any radius,
+// and three stacked boxes are already close to a Gaussian.
+//
+// The horizontal boxes run over groups of rows into a 16-bit intermediate
+// (8.8 fixed point); the vertical boxes run down column strips of it and
+// hand each finished row segment to store, like convolveTile. Pixels beyond
+// the edge are read through borderIndex once, from the source of each axis,
+// so the stacked boxes behave as one kernel with the given border mode.
+
+
+// Radii of three boxes whose stack approximates a Gaussian with
+// sigma = radius / 3, as gaussianTaps uses. Box widths are the two odd
+// integers around the ideal width, mixed so the variances add up to sigma^2
+// (Kovesi, "Fast Almost-Gaussian Filtering").
+inline std::vector<int> gaussianBoxRadii(double radius) {
+    const int box_count = 3;
+    double sigma = std::max(radius, 0.5) / 3.0;
+    double variance = 12.0 * sigma * sigma;
+
+    int lower = static_cast<int>(std::floor(std::sqrt(variance / box_count + 1.0)));
+    if (lower % 2 == 0) lower--;
+    lower = std::max(lower, 1);
+    int upper = lower + 2;
+
+    double ideal = (variance - box_count * lower * lower - 4.0 * box_count * lower - 3.0 * box_count)
+                   / (-4.0 * lower - 4.0);
+    int lower_count = std::min(box_count, std::max(0, static_cast<int>(std::lround(ideal))));
+
+    std::vector<int> radii;
+    for (int i = 0; i < box_count; i++) {
+        radii.push_back(((i < lower_count) ? lower : upper) / 2);
+    }
+    return radii;
+}
+
+
+// One step of a running sum over count lanes: the new sample in replaces
+// the oldest one in the window, and out receives the scaled new sum.
+// Adding (in - oldest) keeps sums of integer samples exact.
+inline void slideWindowScalar(float* sum, float* oldest, const float* in, float* out, float scale, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        float value = sum[i] + (in[i] - oldest[i]);
+        sum[i] = value;
+        oldest[i] = in[i];
+        out[i] = value * scale;
+    }
+}
+
+
+// Converts count 16-bit values to floats.
+inline void widenWordsScalar(float* out, const uint16_t* in, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = in[i];
+    }
+}
+
+
+// Stores count floats in [0, 255] as 8.8 fixed point.
+inline void narrowToWordsScalar(uint16_t* out, const float* in, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = static_cast<uint16_t>(in[i] * 256.0f + 0.5f);
+    }
+}
+
+
+#ifdef MORPH_X86
+
+MORPH_TARGET_SSE2
+inline size_t slideWindowSSE2(float* sum, float* oldest, const float* in, float* out, float scale, size_t count) {
+    const __m128 factor = _mm_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 sample = _mm_loadu_ps(in + i);
+        __m128 value = _mm_add_ps(_mm_loadu_ps(sum + i), _mm_sub_ps(sample, _mm_loadu_ps(oldest + i)));
+        _mm_storeu_ps(sum + i, value);
+        _mm_storeu_ps(oldest + i, sample);
+        _mm_storeu_ps(out + i, _mm_mul_ps(value, factor));
+    }
+    return i;
+}
+
+
+MORPH_TARGET_SSE2
+inline size_t widenWordsSSE2(float* out, const uint16_t* in, size_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm_storeu_ps(out + i, _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero)));
+        _mm_storeu_ps(out + i + 4, _mm_cvtepi32_ps(_mm_unpackhi_epi16(words, zero)));
+    }
+    return i;
+}
+
+
+// SSE2 has no unsigned 32 to 16-bit pack, so values are shifted into the
+// signed range, packed with saturation and shifted back.
+MORPH_TARGET_SSE2
+inline size_t narrowToWordsSSE2(uint16_t* out, const float* in, size_t count) {
+    const __m128 scale = _mm_set1_ps(256.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128i bias = _mm_set1_epi32(32768);
+    const __m128i unbias = _mm_set1_epi16(static_cast<short>(0x8000));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i lo = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in + i), scale), half));
+        __m128i hi = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale), half));
+        __m128i packed = _mm_packs_epi32(_mm_sub_epi32(lo, bias), _mm_sub_epi32(hi, bias));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_xor_si128(packed, unbias));
+    }
+    return i;
+}
+
+
+MORPH_TARGET_AVX2
+inline size_t slideWindowAVX2(float* sum, float* oldest, const float* in, float* out, float scale, size_t count) {
+    const __m256 factor = _mm256_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 sample = _mm256_loadu_ps(in + i);
+        __m256 value = _mm256_add_ps(_mm256_loadu_ps(sum + i), _mm256_sub_ps(sample, _mm256_loadu_ps(oldest + i)));
+        _mm256_storeu_ps(sum + i, value);
+        _mm256_storeu_ps(oldest + i, sample);
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(value, factor));
+    }
+    return i;
+}
+
+
+MORPH_TARGET_AVX2
+inline size_t widenWordsAVX2(float* out, const uint16_t* in, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm256_storeu_ps(out + i, _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(words)));
+    }
+    return i;
+}
+
+
+MORPH_TARGET_AVX2
+inline size_t narrowToWordsAVX2(uint16_t* out, const float* in, size_t count) {
+    const __m256 scale = _mm256_set1_ps(256.0f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i lo = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i), scale), half));
+        __m256i hi = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i + 8), scale), half));
+        // The pack interleaves the 128-bit lanes of lo and hi; reorder them.
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), packed);
+    }
+    return i;
+}
+
+
+MORPH_TARGET_AVX512
+inline size_t slideWindowAVX512(float* sum, float* oldest, const float* in, float* out, float scale, size_t count) {
+    const __m512 factor = _mm512_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m512 sample = _mm512_loadu_ps(in + i);
+        __m512 value = _mm512_add_ps(_mm512_loadu_ps(sum + i), _mm512_sub_ps(sample, _mm512_loadu_ps(oldest + i)));
+        _mm512_storeu_ps(sum + i, value);
+        _mm512_storeu_ps(oldest + i, sample);
+        _mm512_storeu_ps(out + i, _mm512_mul_ps(value, factor));
+    }
+    return i;
+}
+
+
+MORPH_TARGET_AVX512
+inline size_t widenWordsAVX512(float* out, const uint16_t* in, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i words = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        _mm512_storeu_ps(out + i, _mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(words)));
+    }
+    return i;
+}
+
+MORPH_TARGET_AVX512
+inline size_t narrowToWordsAVX512(uint16_t* out, const float* in, size_t count) {
+    const __m512 scale = _mm512_set1_ps(256.0f);
+    const __m512 half = _mm512_set1_ps(0.5f);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m512i words = _mm512_cvttps_epi32(_mm512_add_ps(_mm512_mul_ps(_mm512_loadu_ps(in + i), scale), half));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm512_cvtepi32_epi16(words));
+    }
+    return i;
+}
+
+#endif
+
+
+inline void slideWindow(float* sum, float* oldest, const float* in, float* out, float scale, size_t count,
+                        SimdLevel level) {
+    size_t done = 0;
+
+#ifdef MORPH_X86
+    switch (level) {
+        case SimdLevel::AVX512: done = slideWindowAVX512(sum, oldest, in, out, scale, count); break;
+        case SimdLevel::AVX2: done = slideWindowAVX2(sum, oldest, in, out, scale, count); break;
+        case SimdLevel::SSE2: done = slideWindowSSE2(sum, oldest, in, out, scale, count); break;
+        default: break;
+    }
+#else
+    (void)level;
+#endif
+
+    slideWindowScalar(sum + done, oldest + done, in + done, out + done, scale, count - done);
+}
+
+
+inline void widenWords(float* out, const uint16_t* in, size_t count, SimdLevel level) {
+    size_t done = 0;
+
+#ifdef MORPH_X86
+    switch (level) {
+        case SimdLevel::AVX512: done = widenWordsAVX512(out, in, count); break;
+        case SimdLevel::AVX2: done = widenWordsAVX2(out, in, count); break;
+        case SimdLevel::SSE2: done = widenWordsSSE2(out, in, count); break;
+        default: break;
+    }
+#else
+    (void)level;
+#endif
+
+    widenWordsScalar(out + done, in + done, count - done);
+}
+
+
+inline void narrowToWords(uint16_t* out, const float* in, size_t count, SimdLevel level) {
+    size_t done = 0;
+
+#ifdef MORPH_X86
+    switch (level) {
+        case SimdLevel::AVX512: done = narrowToWordsAVX512(out, in, count); break;
+        case SimdLevel::AVX2: done = narrowToWordsAVX2(out, in, count); break;
+        case SimdLevel::SSE2: done = narrowToWordsSSE2(out, in, count); break;
+        default: break;
+    }
+#else
+    (void)level;
+#endif
+
+    narrowToWordsScalar(out + done, in + done, count - done);
+}
+
+
+// Runs the stacked boxes down `lanes` parallel columns. Each step,
+// input(step, samples) fills the lanes for padded row step, where row 0
+// lies sum(radii) above the first output; once the windows have filled,
+// output(row, filtered) receives one filtered vector per step. Samples are
+// multiplied by input_scale on the way in.
+template <typename InputFn, typename OutputFn>
+void runBoxes(const std::vector<int>& radii, size_t lanes, int output_count, float input_scale,
+              InputFn&& input, OutputFn&& output, SimdLevel level) {
+    int total_radius = 0;
+    size_t ring_floats = 0;
+    for (int radius : radii) {
+        total_radius += radius;
+        ring_floats += static_cast<size_t>(2 * radius + 1) * lanes;
+    }
+
+    // Per box: a ring holding its window of samples, then the running sum
+    // and the filtered vector it passes on. Zeroed, so the first steps of a
+    // window subtract nothing.
+    static thread_local std::vector<float> scratch;
+    scratch.assign(ring_floats + (2 * radii.size() + 1) * lanes, 0.0f);
+    float* samples = scratch.data() + ring_floats + 2 * radii.size() * lanes;
+
+    static thread_local std::vector<size_t> ring_slots;
+    ring_slots.assign(radii.size(), 0);
+
+    const int steps = output_count + 2 * total_radius;
+    for (int step = 0; step < steps; step++) {
+        input(step, samples);
+
+        const float* current = samples;
+        float* ring = scratch.data();
+        float* sums = scratch.data() + ring_floats;
+        // Samples box b has received so far; it starts passing results on
+        // once its window is full.
+        int received = step + 1;
+        bool ready = true;
+
+        for (size_t b = 0; b < radii.size(); b++) {
+            const int window = 2 * radii[b] + 1;
+            float* sum = sums + 2 * b * lanes;
+            float* filtered = sum + lanes;
+            float scale = (b == 0 ? input_scale : 1.0f) / window;
+
+            slideWindow(sum, ring + ring_slots[b] * lanes, current, filtered, scale, lanes, level);
+            if (++ring_slots[b] == static_cast<size_t>(window)) ring_slots[b] = 0;
+            ring += static_cast<size_t>(window) * lanes;
+
+            received -= window - 1;
+            if (received <= 0) {
+                ready = false;
+                break;
+            }
+            current = filtered;
+        }
+
+        if (ready) {
+            output(received - 1, current);
+        }
+    }
+}
+
+
+// Rows per horizontal task.
+const int BOX_ROW_GROUP = 32;
+
+
+// One box along a line of interleaved pixels: out holds length pixels, in
+// length + 2 * radius. Each channel's running sum is its own local so it
+// stays in a register.
+template <int Channels>
+void slideLine(float* out, const float* in, int length, int radius) {
+    static_assert(Channels >= 1 && Channels <= 4, "1 to 4 channels");
+    const int window = 2 * radius + 1;
+    const float scale = 1.0f / window;
+
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+    for (int k = 0; k < window; k++) {
+        const float* p = in + k * Channels;
+        s0 += p[0];
+        if constexpr (Channels > 1) s1 += p[1];
+        if constexpr (Channels > 2) s2 += p[2];
+        if constexpr (Channels > 3) s3 += p[3];
+    }
+
+    for (int x = 0; x < length; x++) {
+        float* o = out + x * Channels;
+        o[0] = s0 * scale;
+        if constexpr (Channels > 1) o[1] = s1 * scale;
+        if constexpr (Channels > 2) o[2] = s2 * scale;
+        if constexpr (Channels > 3) o[3] = s3 * scale;
+        if (x + 1 == length) break;
+
+        const float* entering = in + (x + window) * Channels;
+        const float* leaving = in + x * Channels;
+        s0 += entering[0] - leaving[0];
+        if constexpr (Channels > 1) s1 += entering[1] - leaving[1];
+        if constexpr (Channels > 2) s2 += entering[2] - leaving[2];
+        if constexpr (Channels > 3) s3 += entering[3] - leaving[3];
+    }
+}
+
+
+// Horizontal boxes over rows [first_row, first_row + row_count) of src,
+// written to mid as 8.8 fixed point. Each row is widened into a padded
+// float line and every box slides along it with one running sum per
+// channel; a gathered multi-row layout like the vertical pass uses would
+// cost more in transposes than it saves.
+inline void boxFilterRows(const unsigned char* src, int width, int channels, const std::vector<int>& radii,
+                          BorderMode border, int first_row, int row_count, uint16_t* mid,
+                          SimdLevel level = simdLevel()) {
+    int total_radius = 0;
+    for (int radius : radii) total_radius += radius;
+
+    const size_t stride = static_cast<size_t>(width) * channels;
+    const int padded_columns = width + 2 * total_radius;
+
+    static thread_local std::vector<float> lines;
+    lines.resize(2 * static_cast<size_t>(padded_columns) * channels);
+
+    // As in convolveTile, columns [inside_start, inside_end) of the padded
+    // line lie inside the row and widen as one run.
+    const int inside_start = std::min(padded_columns, total_radius);
+    const int inside_end = std::min(padded_columns, total_radius + width);
+    static thread_local std::vector<size_t> column_offsets;
+    column_offsets.resize(padded_columns);
+    for (int x = 0; x < padded_columns; x++) {
+        column_offsets[x] = static_cast<size_t>(borderIndex(x - total_radius, width, border)) * channels;
+    }
+
+    dispatchLayout(channels, [&](auto layout) {
+        constexpr int Channels = decltype(layout)::channels;
+
+        for (int r = first_row; r < first_row + row_count; r++) {
+            const unsigned char* row = src + static_cast<size_t>(r) * stride;
+            float* in = lines.data();
+            float* out = in + static_cast<size_t>(padded_columns) * Channels;
+
+            widenBytes(in + static_cast<size_t>(inside_start) * Channels, row, stride, level);
+            for (int x = 0; x < padded_columns; x++) {
+                if (x == inside_start) x = inside_end;
+                if (x >= padded_columns) break;
+                for (int c = 0; c < Channels; c++) {
+                    in[x * Channels + c] = row[column_offsets[x] + c];
+                }
+            }
+
+            int length = padded_columns;
+            for (int radius : radii) {
+                length -= 2 * radius;
+                slideLine<Channels>(out, in, length, radius);
+                std::swap(in, out);
+            }
+
+            narrowToWords(mid + static_cast<size_t>(r) * stride, in, stride, level);
+        }
+    });
+}
+
+
+// Floats per step of the vertical boxes, i.e. the width of a strip: enough
+// to amortize a step, few enough that the running sums and the vectors
+// passed between boxes stay in L1.
+const size_t BOX_LANES = 512;
+
+
+// Column strips for the vertical boxes, each covering the full height.
+inline std::vector<ConvolutionTile> planBoxStrips(int width, int height, int channels) {
+    int strip_columns = std::min(width, static_cast<int>(BOX_LANES) / channels);
+
+    std::vector<ConvolutionTile> strips;
+    for (int column = 0; column < width; column += strip_columns) {
+        strips.push_back({0, height, column, std::min(strip_columns, width - column)});
+    }
+    return strips;
+}
+
+
+// Rows of mid the vertical boxes request ahead of use. Consecutive steps
+// read a short segment from a different page each, which the hardware
+// prefetchers do not follow.
+const int BOX_PREFETCH_ROWS = 4;
+
+
+inline void prefetchBytes(const void* address, size_t byte_count) {
+#ifdef MORPH_X86
+    const char* bytes = static_cast<const char*>(address);
+    for (size_t offset = 0; offset < byte_count; offset += 64) {
+        _mm_prefetch(bytes + offset, _MM_HINT_T0);
+    }
+#else
+    (void)address;
+    (void)byte_count;
+#endif
+}
+
+
+// Vertical boxes down one strip of mid, calling store(row, filtered) for
+// each row like convolveTile.
+template <typename StoreFn>
+void boxFilterColumns(const uint16_t* mid, int width, int height, int channels, const std::vector<int>& radii,
+                      BorderMode border, const ConvolutionTile& strip, StoreFn&& store,
+                      SimdLevel level = simdLevel()) {
+    int total_radius = 0;
+    for (int radius : radii) total_radius += radius;
+
+    const size_t stride = static_cast<size_t>(width) * channels;
+    const uint16_t* columns = mid + static_cast<size_t>(strip.first_column) * channels;
+    const size_t lanes = static_cast<size_t>(strip.column_count) * channels;
+
+    runBoxes(radii, lanes, height, 1.0f / 256.0f,
+        [&](int step, float* samples) {
+            int ahead = borderIndex(step + BOX_PREFETCH_ROWS - total_radius, height, border);
+            prefetchBytes(columns + ahead * stride, lanes * sizeof(uint16_t));
+            widenWords(samples, columns + borderIndex(step - total_radius, height, border) * stride, lanes, level);
+        },
+        [&](int row, const float* filtered) {
+            store(row, filtered);
+        }, level);
+}
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MORPH_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// GCC and Clang only emit AVX instructions inside functions that opt in to
+// the target; MSVC accepts the intrinsics anywhere.
+#if defined(MORPH_X86) && (defined(__GNUC__) || defined(__clang__))
+#define MORPH_TARGET_SSE2 __attribute__((target("sse2")))
+#define MORPH_TARGET_AVX2 __attribute__((target("avx2")))
+#define MORPH_TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#define MORPH_TARGET_AVX512_VBMI __attribute__((target("avx512f,avx512bw,avx512vbmi")))
+#else
+#define MORPH_TARGET_SSE2
+#define MORPH_TARGET_AVX2
+#define MORPH_TARGET_AVX512
+#define MORPH_TARGET_AVX512_VBMI
+#endif
+
+
+enum class SimdLevel {
+    Scalar,
+    SSE2,
+    AVX2,
+    AVX512
+};
+
+
+inline const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::SSE2: return "SSE2";
+        case SimdLevel::AVX2: return "AVX2";
+        case SimdLevel::AVX512: return "AVX-512";
+        default: return "scalar";
+    }
+}
+
+
+#ifdef MORPH_X86
+inline void readCpuid(unsigned int leaf, unsigned int subleaf, unsigned int registers[4]) {
+#if defined(_MSC_VER)
+    int values[4];
+    __cpuidex(values, static_cast<int>(leaf), static_cast<int>(subleaf));
+    for (int i = 0; i < 4; i++) registers[i] = static_cast<unsigned int>(values[i]);
+#else
+    __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+
+// XCR0 tells whether the OS saves the wide register state on context switch.
+inline unsigned long long readXcr0() {
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned int low, high;
+    __asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+    return (static_cast<unsigned long long>(high) << 32) | low;
+#endif
+}
+#endif
+
+
+inline SimdLevel detectSimdLevel() {
+#ifdef MORPH_X86
+    unsigned int registers[4];
+    readCpuid(0, 0, registers);
+    unsigned int max_leaf = registers[0];
+    if (max_leaf < 1) return SimdLevel::Scalar;
+
+    readCpuid(1, 0, registers);
+    bool has_sse2 = (registers[3] >> 26) & 1;
+    bool has_osxsave = (registers[2] >> 27) & 1;
+    if (!has_sse2) return SimdLevel::Scalar;
+    if (!has_osxsave || max_leaf < 7) return SimdLevel::SSE2;
+
+    unsigned long long xcr0 = readXcr0();
+    bool os_saves_ymm = (xcr0 & 0x6) == 0x6;
+    bool os_saves_zmm = (xcr0 & 0xE6) == 0xE6;
+
+    readCpuid(7, 0, registers);
+    bool has_avx2 = (registers[1] >> 5) & 1;
+    bool has_avx512f = (registers[1] >> 16) & 1;
+    bool has_avx512bw = (registers[1] >> 30) & 1;
+
+    if (has_avx512f && has_avx512bw && os_saves_zmm) return SimdLevel::AVX512;
+    if (has_avx2 && os_saves_ymm) return SimdLevel::AVX2;
+    return SimdLevel::SSE2;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+
+// Detected once; every kernel dispatches on this unless told otherwise.
+inline SimdLevel simdLevel() {
+    static const SimdLevel level = detectSimdLevel();
+    return level;
+}
+
+
+// AVX-512 VBMI adds byte permutes across a whole register. It is an
+// extension on top of SimdLevel::AVX512 that only some of those CPUs have.
+inline bool hasAvx512Vbmi() {
+#ifdef MORPH_X86
+    static const bool has_vbmi = [] {
+        if (simdLevel() != SimdLevel::AVX512) return false;
+        unsigned int registers[4];
+        readCpuid(7, 0, registers);
+        return ((registers[2] >> 1) & 1) != 0;
+    }();
+    return has_vbmi;
+#else
+    return false;
+#endif
+}
+
+#endif
@@ -1,421 +1,1811 @@
-#ifndef FILTERS_H
-#define FILTERS_H
-
-#include <string>
-#include <vector>
-#include <filesystem>
-#include <iostream>
-#include <algorithm>
-#include <memory>
-
-extern "C" {
-    unsigned char* stbi_load(char const* filename, int* x, int* y, int* channels_in_file, int desired_channels);
-    void stbi_image_free(void* retval_from_stbi_load);
-    int stbi_write_png(char const* filename, int w, int h, int comp, const void* data, int stride_in_bytes);
-    int stbi_write_jpg(char const* filename, int w, int h, int comp, const void* data, int quality);
-    int stbi_write_bmp(char const* filename, int w, int h, int comp, const void* data);
-}
-
-namespace fs = std::filesystem;
-
-
-struct ImageData {
-    std::string original_path;
-    std::string filename;
-    int width;
-    int height;
-    int channels;
-    std::unique_ptr<unsigned char[]> pixels;
-    bool modified;
-
-    ImageData() : width(0), height(0), channels(0), modified(false) {}
-
-    ImageData(ImageData&& other) noexcept
-        : original_path(std::move(other.original_path)),
-          filename(std::move(other.filename)),
-          width(other.width),
-          height(other.height),
-          channels(other.channels),
-          pixels(std::move(other.pixels)),
-          modified(other.modified) {
-        other.width = 0;
-        other.height = 0;
-        other.channels = 0;
-        other.modified = false;
-    }
-
-    ImageData& operator=(ImageData&& other) noexcept {
-        if (this != &other) {
-            original_path = std::move(other.original_path);
-            filename = std::move(other.filename);
-            width = other.width;
-            height = other.height;
-            channels = other.channels;
-            pixels = std::move(other.pixels);
-            modified = other.modified;
-
-            other.width = 0;
-            other.height = 0;
-            other.channels = 0;
-            other.modified = false;
-        }
-        return *this;
-    }
-
-    ImageData(const ImageData&) = delete;
-    ImageData& operator=(const ImageData&) = delete;
-};
-
-
-class Pipeline {
-private:
-    std::string base_folder;
-    std::string input_folder;
-    std::string output_folder;
-    std::vector<ImageData> loaded_images;
-
-
-    void createFolderStructure() {
-        if (!fs::exists(base_folder)) {
-            fs::create_directory(base_folder);
-            std::cout << "Created Morph folder: " << base_folder << std::endl;
-        }
-
-        if (!fs::exists(input_folder)) {
-            fs::create_directory(input_folder);
-            std::cout << "Created input folder: " << input_folder << std::endl;
-        }
-
-        if (!fs::exists(output_folder)) {
-            fs::create_directory(output_folder);
-            std::cout << "Created output folder: " << output_folder << std::endl;
-        }
-    }
-
-
-    bool isValidImageFormat(const std::string& extension) {
-        std::string ext = extension;
-        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-        
-        return ext == ".jpg" || ext == ".jpeg" || ext == ".png" || ext == ".bmp" ||
-               ext == ".tga" || ext == ".gif" || ext == ".webp" || ext == ".tiff" || ext == ".tif";
-    }
-
-
-    bool loadSingleImage(const std::string& file_path) {
-        ImageData img;
-
-        unsigned char* data = stbi_load(file_path.c_str(), &img.width, &img.height, &img.channels, 0);
-        if (!data) {
-            std::cerr << "Failed to load: " << file_path << std::endl;
-            return false;
-        }
-
-        size_t data_size = img.width * img.height * img.channels;
-        img.pixels = std::unique_ptr<unsigned char[]>(new unsigned char[data_size]);
-        std::copy(data, data + data_size, img.pixels.get());
-
-        img.original_path = file_path;
-        img.filename = fs::path(file_path).filename().string();
-        std::transform(img.filename.begin(), img.filename.end(), img.filename.begin(), ::tolower);
-        img.modified = false;
-
-        stbi_image_free(data);
-        loaded_images.push_back(std::move(img));
-        
-        return true;
-    }
-
-
-    ImageData* findImageByName(const std::string& target_name) {
-        std::string target_lower = target_name;
-        std::transform(target_lower.begin(), target_lower.end(), target_lower.begin(), ::tolower);
-
-        for (auto& img : loaded_images) {
-            if (img.filename == target_lower) {
-                return &img;
-            }
-        }
-        return nullptr;
-    }
-
-
-    bool writeImageToFile(const ImageData& img, const std::string& output_path) {
-        fs::path original_path(img.original_path);
-        std::string ext = original_path.extension().string();
-        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-
-        if (ext == ".png") {
-            return stbi_write_png(output_path.c_str(), img.width, img.height,
-                                img.channels, img.pixels.get(), img.width * img.channels);
-        }
-        else if (ext == ".jpg" || ext == ".jpeg") {
-            return stbi_write_jpg(output_path.c_str(), img.width, img.height,
-                                img.channels, img.pixels.get(), 95);
-        }
-        else if (ext == ".bmp") {
-            return stbi_write_bmp(output_path.c_str(), img.width, img.height,
-                                img.channels, img.pixels.get());
-        }
-        
-        return false;
-    }
-
-public:
-    Pipeline() : base_folder("Morph"),
-                 input_folder("Morph/input"),
-                 output_folder("Morph/output") {
-        createFolderStructure();
-    }
-
-
-    bool addInput(const std::string& path) {
-        if (!fs::exists(path)) {
-            std::cerr << "Path not found: " << path << std::endl;
-            return false;
-        }
-
-        if (fs::is_regular_file(path)) {
-            std::string ext = fs::path(path).extension().string();
-            
-            if (!isValidImageFormat(ext)) {
-                std::cerr << "Not a valid image file" << std::endl;
-                return false;
-            }
-
-            std::string filename = fs::path(path).filename().string();
-            std::cout << "Loading: " << filename << std::endl;
-
-            if (loadSingleImage(path)) {
-                std::cout << "Added: " << filename << std::endl;
-                return true;
-            }
-            return false;
-        }
-
-        if (!fs::is_directory(path)) {
-            std::cerr << "Invalid path: " << path << std::endl;
-            return false;
-        }
-
-        int count = 0;
-        for (const auto& entry : fs::directory_iterator(path)) {
-            if (entry.is_regular_file()) {
-                std::string ext = entry.path().extension().string();
-
-                if (isValidImageFormat(ext)) {
-                    std::string filename = entry.path().filename().string();
-                    std::cout << "Loading: " << filename << std::endl;
-
-                    if (loadSingleImage(entry.path().string())) {
-                        count++;
-                    }
-                }
-            }
-        }
-
-        std::cout << "Loaded " << count << " image(s)" << std::endl;
-        return count > 0;
-    }
-
-
-    bool applyGrayscale(const std::string& target = "", double intensity = 100) {
-        if (loaded_images.empty()) {
-            std::cerr << "No images in input. Use: -i @\"path\"" << std::endl;
-            return false;
-        }
-
-        intensity = std::max(0.0, std::min(100.0, intensity));
-        double blend = intensity / 100.0;
-
-        const double red_weight = 0.299;
-        const double green_weight = 0.587;
-        const double blue_weight = 0.114;
-
-        std::cout << "Applying grayscale (" << intensity << "%)..." << std::endl;
-
-        int processed_count = 0;
-        
-        for (auto& img : loaded_images) {
-            if (!target.empty()) {
-                std::string target_lower = target;
-                std::transform(target_lower.begin(), target_lower.end(), target_lower.begin(), ::tolower);
-                
-                if (img.filename != target_lower) {
-                    continue;
-                }
-            }
-
-            for (int pixel = 0; pixel < img.width * img.height; pixel++) {
-                int index = pixel * img.channels;
-                
-                unsigned char red = img.pixels[index];
-                unsigned char green = (img.channels > 1) ? img.pixels[index + 1] : red;
-                unsigned char blue = (img.channels > 2) ? img.pixels[index + 2] : red;
-
-                unsigned char gray_value = static_cast<unsigned char>(
-                    red_weight * red + green_weight * green + blue_weight * blue
-                );
-
-                unsigned char new_red = static_cast<unsigned char>((1.0 - blend) * red + blend * gray_value);
-                unsigned char new_green = static_cast<unsigned char>((1.0 - blend) * green + blend * gray_value);
-                unsigned char new_blue = static_cast<unsigned char>((1.0 - blend) * blue + blend * gray_value);
-
-                img.pixels[index] = new_red;
-                if (img.channels > 1) img.pixels[index + 1] = new_green;
-                if (img.channels > 2) img.pixels[index + 2] = new_blue;
-            }
-
-            img.modified = true;
-            std::cout << "[OK] " << img.filename << std::endl;
-            processed_count++;
-
-            if (!target.empty()) break;
-        }
-
-        if (processed_count == 0 && !target.empty()) {
-            std::cerr << "Image not found in input: " << target << std::endl;
-            return false;
-        }
-
-        return true;
-    }
-
-
-    bool savePreview(const std::string& target = "") {
-        if (loaded_images.empty()) {
-            std::cerr << "No images in input." << std::endl;
-            return false;
-        }
-
-        std::cout << "Saving preview to: " << output_folder << std::endl;
-
-        int saved_count = 0;
-        
-        for (const auto& img : loaded_images) {
-            if (!target.empty()) {
-                std::string target_lower = target;
-                std::transform(target_lower.begin(), target_lower.end(), target_lower.begin(), ::tolower);
-                
-                if (img.filename != target_lower) {
-                    continue;
-                }
-            }
-
-            fs::path output_path = fs::path(output_folder) / img.filename;
-            bool success = writeImageToFile(img, output_path.string());
-
-            if (success) {
-                std::cout << "[OK] " << img.filename << std::endl;
-                saved_count++;
-            }
-            else {
-                std::cerr << "[FAIL] " << img.filename << std::endl;
-            }
-
-            if (!target.empty()) break;
-        }
-
-        std::cout << "Saved " << saved_count << " preview(s) to disk" << std::endl;
-        return saved_count > 0;
-    }
-
-
-    bool exportOutput(const std::string& output_path, bool clear_input = true, const std::string& target = "") {
-        if (loaded_images.empty()) {
-            std::cerr << "No images in input." << std::endl;
-            return false;
-        }
-
-        fs::path out_dir(output_path);
-        if (!fs::exists(out_dir)) {
-            try {
-                fs::create_directories(out_dir);
-            }
-            catch (const fs::filesystem_error& e) {
-                std::cerr << "Failed to create output directory" << std::endl;
-                return false;
-            }
-        }
-
-        std::cout << "Exporting to: " << output_path << std::endl;
-
-        std::vector<size_t> images_to_remove;
-        int exported_count = 0;
-
-        for (size_t i = 0; i < loaded_images.size(); i++) {
-            const auto& img = loaded_images[i];
-
-            if (!target.empty()) {
-                std::string target_lower = target;
-                std::transform(target_lower.begin(), target_lower.end(), target_lower.begin(), ::tolower);
-                
-                if (img.filename != target_lower) {
-                    continue;
-                }
-            }
-
-            fs::path output_file = out_dir / img.filename;
-            bool success = writeImageToFile(img, output_file.string());
-
-            if (success) {
-                std::cout << "[OK] " << img.filename << std::endl;
-                exported_count++;
-                
-                if (clear_input) {
-                    images_to_remove.push_back(i);
-                }
-            }
-            else {
-                std::cerr << "[FAIL] " << img.filename << std::endl;
-            }
-
-            if (!target.empty()) break;
-        }
-
-        std::cout << "Export complete! (" << exported_count << " file(s))" << std::endl;
-
-        if (clear_input && !images_to_remove.empty()) {
-            std::cout << "Clearing " << images_to_remove.size() << " image(s) from input..." << std::endl;
-            
-            for (auto it = images_to_remove.rbegin(); it != images_to_remove.rend(); ++it) {
-                loaded_images.erase(loaded_images.begin() + *it);
-            }
-            
-            std::cout << "Input cleared!" << std::endl;
-        }
-
-        return exported_count > 0;
-    }
-
-
-    void listInput() const {
-        if (loaded_images.empty()) {
-            std::cout << "No images in input." << std::endl;
-            return;
-        }
-
-        std::cout << "Images in input (" << loaded_images.size() << "):" << std::endl;
-        
-        for (const auto& img : loaded_images) {
-            std::string status = img.modified ? " [MODIFIED]" : "";
-            size_t memory_size = img.width * img.height * img.channels;
-            double size_in_mb = memory_size / (1024.0 * 1024.0);
-            
-            std::cout << "  - " << img.filename 
-                     << " (" << img.width << "x" << img.height << ", " << size_in_mb << " MB)" 
-                     << status << std::endl;
-        }
-    }
-
-
-    size_t getMemoryUsage() const {
-        size_t total_bytes = 0;
-        for (const auto& img : loaded_images) {
-            total_bytes += img.width * img.height * img.channels;
-        }
-        return total_bytes;
-    }
-};
-
-#endif
+#ifndef FILTERS_H
+#define FILTERS_H
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <iostream>
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <atomic>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cmath>
+#include <climits>
+#include <cstdlib>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include "thread_pool.h"
+#include "pixel_allocator.h"
+#include "bounded_queue.h"
+#include "reporter.h"
+#include "stats.h"
+#include "trace.h"
+#include "grayscale_kernels.h"
+#include "lut_kernels.h"
+#include "convolution.h"
+#include "mapped_file.h"
+
+extern "C" {
+    unsigned char* stbi_load(char const* filename, int* x, int* y, int* channels_in_file, int desired_channels);
+    int stbi_info(char const* filename, int* x, int* y, int* comp);
+    unsigned char* stbi_load_from_memory(unsigned char const* buffer, int len, int* x, int* y, int* channels_in_file, int desired_channels);
+    int stbi_write_png(char const* filename, int w, int h, int comp, const void* data, int stride_in_bytes);
+    int stbi_write_jpg(char const* filename, int w, int h, int comp, const void* data, int quality);
+    int stbi_write_bmp(char const* filename, int w, int h, int comp, const void* data);
+}
+
+namespace fs = std::filesystem;
+
+
+// Pixel buffers come straight from the stb decoders, and stb_config.h routes
+// STBI_MALLOC, STBI_REALLOC and STBI_FREE to the pixel pool, so every buffer
+// (including those from allocatePixels) is returned to the pool here rather
+// than released with delete[].
+struct PixelDeleter {
+    void operator()(unsigned char* pixels) const {
+        pixelFree(pixels);
+    }
+};
+
+using PixelBuffer = std::unique_ptr<unsigned char[], PixelDeleter>;
+
+
+inline unsigned char* allocatePixels(size_t byte_count) {
+    return static_cast<unsigned char*>(pixelMalloc(byte_count));
+}
+
+
+// One recorded filter step. Ops are queued per image and only touch pixels
+// when the pipeline runs them, so a chain of adjustments can be fused.
+//
+// Point ops (grayscale and the tone adjustments) read nothing but the pixel
+// they write and run band by band. Spatial ops (blur, box blur, sharpen)
+// read neighbouring rows, so they run over the whole image on their own and
+// act as barriers between fused runs.
+struct FilterOp {
+    enum class Kind {
+        Grayscale,
+        Adjust,
+        Blur,
+        BoxBlur,
+        Sharpen
+    };
+
+    Kind kind;
+    int amount;                                     // blend weight in 1/256 steps
+    float radius = 0.0f;                            // Blur, Sharpen: Gaussian radius; BoxBlur: box radius
+    float strength = 0.0f;                          // Sharpen: gain applied to the detail
+    BorderMode border = BorderMode::Clamp;          // spatial ops: pixels outside the image
+    const char* adjustment = "adjust";              // Adjust: command name, or "adjust" once fused
+    std::shared_ptr<const PointLut> lut = nullptr;  // Adjust: tone curve, shared by every image's copy
+
+    const char* name() const {
+        switch (kind) {
+            case Kind::Grayscale: return "grayscale";
+            case Kind::Adjust: return adjustment;
+            case Kind::Blur: return "blur";
+            case Kind::BoxBlur: return "box blur";
+            case Kind::Sharpen: return "sharpen";
+        }
+        return "filter";
+    }
+
+    bool isPointOp() const {
+        return kind == Kind::Grayscale || kind == Kind::Adjust;
+    }
+
+    // Folds next into this op when the pair can run as a single kernel.
+    // Blending toward gray twice leaves the gray value unchanged, so two
+    // blends b1, b2 equal one blend of 1 - (1 - b1)(1 - b2). Tone curves
+    // compose into one table.
+    bool absorb(const FilterOp& next) {
+        if (kind == Kind::Grayscale && next.kind == Kind::Grayscale) {
+            amount = 256 - ((256 - amount) * (256 - next.amount) + 128) / 256;
+            return true;
+        }
+        if (kind == Kind::Adjust && next.kind == Kind::Adjust) {
+            lut = std::make_shared<const PointLut>(lut->then(*next.lut));
+            if (std::string(adjustment) != next.adjustment) {
+                adjustment = "adjust";
+            }
+            return true;
+        }
+        return false;
+    }
+};
+
+
+// Blend weight in 1/256 steps for a percentage, clamped to 0-100.
+inline int blendWeight(double percent) {
+    percent = std::max(0.0, std::min(100.0, percent));
+    return static_cast<int>(std::lround(percent * 256.0 / 100.0));
+}
+
+
+inline FilterOp makeGrayscaleOp(double intensity) {
+    return {FilterOp::Kind::Grayscale, blendWeight(intensity)};
+}
+
+
+// A tone adjustment; any blend with the original is already in the table.
+inline FilterOp makeAdjustOp(const char* adjustment, const PointLut& lut) {
+    FilterOp op = {FilterOp::Kind::Adjust, 256};
+    op.adjustment = adjustment;
+    op.lut = std::make_shared<const PointLut>(lut);
+    return op;
+}
+
+
+// Adds amount percent of full scale (-100 to 100).
+inline FilterOp makeBrightnessOp(double amount) {
+    double offset = amount / 100.0;
+    return makeAdjustOp("brightness", makePointLut([=](double v) { return v + offset; }));
+}
+
+
+// Scales the distance from mid gray. The slope is tan((amount + 100) * 45 /
+// 100 degrees): -100 flattens the image to gray, 0 keeps it and 100 is a
+// threshold at mid gray.
+inline FilterOp makeContrastOp(double amount) {
+    double slope = std::tan((amount + 100.0) / 100.0 * std::atan(1.0));
+    return makeAdjustOp("contrast", makePointLut([=](double v) { return (v - 0.5) * slope + 0.5; }));
+}
+
+
+// v^(1 / gamma): above 1 brightens the midtones, below 1 darkens them.
+inline FilterOp makeGammaOp(double gamma) {
+    return makeAdjustOp("gamma", makePointLut([=](double v) { return std::pow(v, 1.0 / gamma); }));
+}
+
+
+// Stretches black..white (0-255, black < white) to the full range, then
+// applies gamma.
+inline FilterOp makeLevelsOp(int black, int white, double gamma) {
+    return makeAdjustOp("levels", makePointLut([=](double v) {
+        double stretched = std::max(0.0, std::min(1.0, (v * 255.0 - black) / (white - black)));
+        return std::pow(stretched, 1.0 / gamma);
+    }));
+}
+
+
+// Negative image, blended with the original by percent.
+inline FilterOp makeInvertOp(double percent) {
+    double mix = blendWeight(percent) / 256.0;
+    return makeAdjustOp("invert", makePointLut([=](double v) { return v + (1.0 - 2.0 * v) * mix; }));
+}
+
+
+// Gaussian blur reaching radius pixels, blended with the original by percent.
+inline FilterOp makeBlurOp(double radius, double percent) {
+    FilterOp op = {FilterOp::Kind::Blur, blendWeight(percent)};
+    op.radius = static_cast<float>(radius);
+    return op;
+}
+
+
+// Plain average over a (2 * radius + 1)^2 square. Radii below 1 are raised
+// to 1; the box passes size and index the window by radius.
+inline FilterOp makeBoxBlurOp(int radius, double percent) {
+    FilterOp op = {FilterOp::Kind::BoxBlur, blendWeight(percent)};
+    op.radius = static_cast<float>(std::max(radius, 1));
+    return op;
+}
+
+
+// Unsharp mask: out = in + strength * (in - blur(in)) with a small fixed
+// radius, so strength 1 doubles local contrast at fine detail.
+const float SHARPEN_RADIUS = 3.0f;
+
+inline FilterOp makeSharpenOp(double strength, double percent) {
+    FilterOp op = {FilterOp::Kind::Sharpen, blendWeight(percent)};
+    op.radius = SHARPEN_RADIUS;
+    op.strength = static_cast<float>(strength);
+    return op;
+}
+
+
+// Stats stage a filter's time and images are counted under.
+inline StatStage statStageFor(const FilterOp& op) {
+    switch (op.kind) {
+        case FilterOp::Kind::Grayscale: return StatStage::Grayscale;
+        case FilterOp::Kind::Adjust: return StatStage::Adjust;
+        case FilterOp::Kind::Sharpen: return StatStage::Sharpen;
+        default: return StatStage::Blur;
+    }
+}
+
+
+// Runs a point op over pixel_count pixels. Every call is timed under its
+// filter's stats stage; the caller counts the image.
+inline void applyFilterOp(const FilterOp& op, unsigned char* pixels, size_t pixel_count, int channels) {
+    uint64_t byte_count = static_cast<uint64_t>(pixel_count) * channels;
+
+    switch (op.kind) {
+        case FilterOp::Kind::Grayscale: {
+            KernelTimer timer(StatStage::Grayscale, byte_count);
+            grayscalePixels(pixels, pixel_count, channels, op.amount);
+            break;
+        }
+        case FilterOp::Kind::Adjust: {
+            KernelTimer timer(StatStage::Adjust, byte_count);
+            lookupPixels(pixels, pixel_count, channels, *op.lut);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+
+struct ImageData {
+    std::string original_path;
+    std::string filename;
+    int width;
+    int height;
+    int channels;
+    PixelBuffer pixels;
+    bool modified;
+    std::vector<FilterOp> pending_ops;
+    uint64_t last_used;
+    std::string spill_path;
+
+    ImageData() : width(0), height(0), channels(0), modified(false), last_used(0) {}
+
+    ImageData(ImageData&& other) noexcept
+        : original_path(std::move(other.original_path)),
+          filename(std::move(other.filename)),
+          width(other.width),
+          height(other.height),
+          channels(other.channels),
+          pixels(std::move(other.pixels)),
+          modified(other.modified),
+          pending_ops(std::move(other.pending_ops)),
+          last_used(other.last_used),
+          spill_path(std::move(other.spill_path)) {
+        other.width = 0;
+        other.height = 0;
+        other.channels = 0;
+        other.modified = false;
+    }
+
+    ImageData& operator=(ImageData&& other) noexcept {
+        if (this != &other) {
+            original_path = std::move(other.original_path);
+            filename = std::move(other.filename);
+            width = other.width;
+            height = other.height;
+            channels = other.channels;
+            pixels = std::move(other.pixels);
+            modified = other.modified;
+            pending_ops = std::move(other.pending_ops);
+            last_used = other.last_used;
+            spill_path = std::move(other.spill_path);
+
+            other.width = 0;
+            other.height = 0;
+            other.channels = 0;
+            other.modified = false;
+        }
+        return *this;
+    }
+
+    ImageData(const ImageData&) = delete;
+    ImageData& operator=(const ImageData&) = delete;
+
+
+    // Size of the decoded pixels, whether or not they are resident.
+    size_t byteSize() const {
+        return static_cast<size_t>(width) * height * channels;
+    }
+};
+
+
+// A horizontal slice of one image; the unit of work for per-pixel filters.
+struct RowBand {
+    ImageData* image;
+    int first_row;
+    int row_count;
+
+    unsigned char* data() const {
+        return image->pixels.get() + static_cast<size_t>(first_row) * image->width * image->channels;
+    }
+
+    size_t pixelCount() const {
+        return static_cast<size_t>(row_count) * image->width;
+    }
+};
+
+
+// Gaussian blurs wider than this run as three stacked box filters, whose
+// cost per pixel does not depend on the radius; below it the exact
+// Gaussian taps are faster.
+const float BOX_BLUR_MIN_RADIUS = 12.0f;
+
+
+// Temporary bytes applySpatialOp allocates for op on img: the result buffer,
+// plus the 16-bit intermediate when the blur runs as box passes. Point ops
+// work in place and need none.
+inline size_t spatialScratchBytes(const FilterOp& op, const ImageData& img) {
+    if (op.isPointOp() || op.amount <= 0) return 0;
+
+    bool box_passes = op.kind == FilterOp::Kind::BoxBlur ||
+                      (op.kind == FilterOp::Kind::Blur && op.radius > BOX_BLUR_MIN_RADIUS);
+    return img.byteSize() * (box_passes ? 1 + sizeof(uint16_t) : 1);
+}
+
+
+// Blurs or sharpens a whole image into a new buffer and swaps it in; the
+// filter reads neighbours, so it cannot work in place. Work runs on pool
+// when one is given, otherwise on the calling thread, and each tile, row
+// group or strip is one timed kernel call. Alpha is copied unchanged.
+inline void applySpatialOp(const FilterOp& op, ImageData& img, ThreadPool* pool) {
+    if (op.amount <= 0 || !img.pixels) return;
+
+    const unsigned char* src = img.pixels.get();
+    PixelBuffer result(allocatePixels(img.byteSize()));
+    if (!result) throw std::bad_alloc();
+    unsigned char* dst = result.get();
+
+    const int channels = img.channels;
+    const size_t stride = static_cast<size_t>(img.width) * channels;
+    const int blend = op.amount;
+    const bool sharpen = (op.kind == FilterOp::Kind::Sharpen);
+    // A blur keeps the filtered value; the unsharp mask in + s * (in - blur)
+    // is (1 + s) * in - s * blur.
+    const float source_weight = sharpen ? 1.0f + op.strength : 0.0f;
+    const float filtered_weight = sharpen ? -op.strength : 1.0f;
+    const StatStage stage = statStageFor(op);
+    const SimdLevel level = simdLevel();
+
+    std::vector<int> box_radii;
+    if (op.kind == FilterOp::Kind::BoxBlur) {
+        box_radii.push_back(static_cast<int>(op.radius));
+    }
+    else if (op.kind == FilterOp::Kind::Blur && op.radius > BOX_BLUR_MIN_RADIUS) {
+        box_radii = gaussianBoxRadii(op.radius);
+    }
+
+    auto run_tasks = [&](size_t count, auto&& task) {
+        if (pool) {
+            pool->parallelFor(count, task);
+        }
+        else {
+            for (size_t i = 0; i < count; i++) {
+                task(i);
+            }
+        }
+    };
+
+    dispatchLayout(channels, [&](auto layout) {
+        using Layout = decltype(layout);
+
+        auto store = [&](const ConvolutionTile& tile, int row, const float* filtered) {
+            size_t offset = row * stride + static_cast<size_t>(tile.first_column) * channels;
+            const unsigned char* in = src + offset;
+            unsigned char* out = dst + offset;
+            const size_t count = static_cast<size_t>(tile.column_count) * Layout::channels;
+
+            // Every channel goes through the blend, then alpha is put back.
+            blendFiltered(out, in, filtered, count, source_weight, filtered_weight, blend, level);
+            if constexpr (Layout::has_alpha) {
+                for (size_t i = Layout::channels - 1; i < count; i += Layout::channels) {
+                    out[i] = in[i];
+                }
+            }
+        };
+
+        if (box_radii.empty()) {
+            std::vector<float> taps = gaussianTaps(op.radius);
+            std::vector<ConvolutionTile> tiles = planConvolutionTiles(img.width, img.height, channels,
+                                                                      static_cast<int>(taps.size() / 2));
+
+            run_tasks(tiles.size(), [&](size_t t) {
+                const ConvolutionTile& tile = tiles[t];
+                uint64_t tile_pixels = static_cast<uint64_t>(tile.row_count) * tile.column_count;
+                KernelTimer timer(stage, tile_pixels * channels);
+                TraceSpan span(op.name(), img.filename, tile_pixels);
+
+                convolveTile(src, img.width, img.height, channels, taps, op.border, tile,
+                             [&](int row, const float* filtered) { store(tile, row, filtered); }, level);
+            });
+            return;
+        }
+
+        // Horizontal boxes into an 8.8 fixed point copy, then vertical boxes
+        // down column strips of it. Bytes are counted once, by the strips.
+        // The copy comes from the pixel pool like any frame, so repeated
+        // blurs reuse it instead of faulting in fresh pages.
+        PixelBuffer mid_buffer(allocatePixels(img.byteSize() * sizeof(uint16_t)));
+        if (!mid_buffer) throw std::bad_alloc();
+        uint16_t* mid = reinterpret_cast<uint16_t*>(mid_buffer.get());
+
+        size_t row_groups = (static_cast<size_t>(img.height) + BOX_ROW_GROUP - 1) / BOX_ROW_GROUP;
+        run_tasks(row_groups, [&](size_t g) {
+            int first_row = static_cast<int>(g) * BOX_ROW_GROUP;
+            int row_count = std::min(BOX_ROW_GROUP, img.height - first_row);
+            KernelTimer timer(stage);
+            TraceSpan span(op.name(), img.filename, static_cast<uint64_t>(row_count) * img.width);
+
+            boxFilterRows(src, img.width, channels, box_radii, op.border, first_row, row_count, mid, level);
+        });
+
+        std::vector<ConvolutionTile> strips = planBoxStrips(img.width, img.height, channels);
+        run_tasks(strips.size(), [&](size_t s) {
+            const ConvolutionTile& strip = strips[s];
+            uint64_t strip_pixels = static_cast<uint64_t>(strip.row_count) * strip.column_count;
+            KernelTimer timer(stage, strip_pixels * channels);
+            TraceSpan span(op.name(), img.filename, strip_pixels);
+
+            boxFilterColumns(mid, img.width, img.height, channels, box_radii, op.border, strip,
+                             [&](int row, const float* filtered) { store(strip, row, filtered); }, level);
+        });
+    });
+
+    img.pixels = std::move(result);
+    KernelTimer::countImage(stage);
+}
+
+
+class Pipeline {
+private:
+    // Bands are sized to stay resident in L2 while a filter runs over them,
+    // and large enough that scheduling cost stays negligible.
+    static const size_t BAND_BYTES = 256 * 1024;
+
+
+    std::string base_folder;
+    std::string input_folder;
+    std::string output_folder;
+    std::vector<ImageData> loaded_images;
+    std::unordered_map<std::string, size_t> image_index;
+    std::unique_ptr<ThreadPool> pool;
+    bool defer_filters;
+    bool lazy_loading;
+    size_t memory_limit;
+    uint64_t use_clock;
+    uint64_t spill_counter;
+    unsigned int decode_threads;
+    unsigned int filter_threads;
+    unsigned int encode_threads;
+    BorderMode border_mode;
+    Reporter reporter;
+
+
+    // One image moving between streaming stages.
+    struct StreamItem {
+        size_t file_index;
+        ImageData image;
+    };
+
+
+    // Time a streaming stage spent working, as opposed to waiting on its
+    // queues; busy / (wall time * threads) is the stage's utilization.
+    struct StageStats {
+        const char* name;
+        unsigned int threads;
+        std::atomic<long long> busy_ns;
+        std::atomic<size_t> items;
+
+        StageStats(const char* stage_name, unsigned int thread_count)
+            : name(stage_name), threads(thread_count), busy_ns(0), items(0) {}
+
+        void record(std::chrono::steady_clock::time_point start_time) {
+            busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start_time).count();
+            items++;
+        }
+    };
+
+
+    void createFolderStructure() {
+        StatTimer timer(StatStage::Filesystem);
+
+        if (!fs::exists(base_folder)) {
+            fs::create_directory(base_folder);
+            std::cout << "Created Morph folder: " << base_folder << std::endl;
+        }
+
+        if (!fs::exists(input_folder)) {
+            fs::create_directory(input_folder);
+            std::cout << "Created input folder: " << input_folder << std::endl;
+        }
+
+        if (!fs::exists(output_folder)) {
+            fs::create_directory(output_folder);
+            std::cout << "Created output folder: " << output_folder << std::endl;
+        }
+    }
+
+
+    bool isValidImageFormat(const std::string& extension) {
+        std::string ext = extension;
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        
+        return ext == ".jpg" || ext == ".jpeg" || ext == ".png" || ext == ".bmp" ||
+               ext == ".tga" || ext == ".gif" || ext == ".webp" || ext == ".tiff" || ext == ".tif";
+    }
+
+
+    // Supported image files directly inside folder, sorted by path.
+    std::vector<std::string> listImageFiles(const std::string& folder) {
+        StatTimer timer(StatStage::Filesystem);
+        std::vector<std::string> image_paths;
+        for (const auto& entry : fs::directory_iterator(folder)) {
+            if (entry.is_regular_file() && isValidImageFormat(entry.path().extension().string())) {
+                image_paths.push_back(entry.path().string());
+            }
+        }
+        std::sort(image_paths.begin(), image_paths.end());
+        return image_paths;
+    }
+
+
+    bool createOutputDirectory(const fs::path& out_dir) {
+        StatTimer timer(StatStage::Filesystem);
+        if (fs::exists(out_dir)) return true;
+
+        try {
+            fs::create_directories(out_dir);
+        }
+        catch (const fs::filesystem_error& e) {
+            reporter.error("Failed to create output directory");
+            return false;
+        }
+        return true;
+    }
+
+
+    // Decodes one file into img without touching the pipeline, so it can run
+    // on any worker thread.
+    static bool decodeImage(const std::string& file_path, ImageData& img) {
+        StatTimer timer(StatStage::Decode);
+        const std::string filename = sourceFilename(file_path);
+        TraceSpan span("decode", filename);
+
+        // Decode straight from a read-only mapping and unmap as soon as the
+        // pixels exist. stb takes an int length, so huge files and anything
+        // that cannot be mapped go through stbi_load instead.
+        MappedFile file;
+        if (file.open(file_path) && file.size() <= static_cast<size_t>(INT_MAX)) {
+            img.pixels = PixelBuffer(stbi_load_from_memory(file.data(), static_cast<int>(file.size()),
+                                                           &img.width, &img.height, &img.channels, 0));
+            file.close();
+        }
+        else {
+            img.pixels = PixelBuffer(stbi_load(file_path.c_str(), &img.width, &img.height, &img.channels, 0));
+        }
+
+        if (!img.pixels) {
+            return false;
+        }
+
+        timer.setBytes(img.byteSize());
+        span.setPixels(static_cast<uint64_t>(img.width) * img.height);
+        setSource(img, file_path);
+        return true;
+    }
+
+
+    // Reads only width, height and channel count; pixels stay empty until
+    // makeResident decodes them.
+    static bool readImageHeader(const std::string& file_path, ImageData& img) {
+        StatTimer timer(StatStage::Filesystem);
+        if (!stbi_info(file_path.c_str(), &img.width, &img.height, &img.channels)) {
+            return false;
+        }
+
+        setSource(img, file_path);
+        return true;
+    }
+
+
+    // Lowercased file name an image is known by in the index, messages and
+    // trace spans.
+    static std::string sourceFilename(const std::string& file_path) {
+        std::string filename = fs::path(file_path).filename().string();
+        std::transform(filename.begin(), filename.end(), filename.begin(), ::tolower);
+        return filename;
+    }
+
+
+    static void setSource(ImageData& img, const std::string& file_path) {
+        img.original_path = file_path;
+        img.filename = sourceFilename(file_path);
+        img.modified = false;
+    }
+
+
+    // Spill files are a fixed header followed by the raw pixels, so writing
+    // and reading them is a single bulk transfer.
+    struct SpillHeader {
+        char magic[4];
+        int32_t width;
+        int32_t height;
+        int32_t channels;
+    };
+
+
+    static bool writeSpillFile(const ImageData& img, const std::string& spill_path) {
+        StatTimer timer(StatStage::Filesystem, img.byteSize());
+        TraceSpan span("spill write", img.filename, static_cast<uint64_t>(img.width) * img.height);
+        std::ofstream spill(spill_path, std::ios::binary | std::ios::trunc);
+        if (!spill) return false;
+
+        SpillHeader header = {{'M', 'R', 'A', 'W'}, img.width, img.height, img.channels};
+        spill.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        spill.write(reinterpret_cast<const char*>(img.pixels.get()), static_cast<std::streamsize>(img.byteSize()));
+        return static_cast<bool>(spill);
+    }
+
+
+    // filename labels the trace span, like the image's other spans.
+    static bool readSpillFile(const std::string& spill_path, const std::string& filename, ImageData& img) {
+        StatTimer timer(StatStage::Filesystem);
+        TraceSpan span("spill read", filename);
+        std::ifstream spill(spill_path, std::ios::binary);
+        SpillHeader header;
+        if (!spill || !spill.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            std::string(header.magic, 4) != "MRAW") {
+            return false;
+        }
+
+        img.width = header.width;
+        img.height = header.height;
+        img.channels = header.channels;
+        img.pixels = PixelBuffer(allocatePixels(img.byteSize()));
+        if (!img.pixels) return false;
+
+        timer.setBytes(img.byteSize());
+        span.setPixels(static_cast<uint64_t>(img.width) * img.height);
+        spill.read(reinterpret_cast<char*>(img.pixels.get()), static_cast<std::streamsize>(img.byteSize()));
+        return static_cast<bool>(spill);
+    }
+
+
+    void discardSpillFile(ImageData& img) {
+        if (img.spill_path.empty()) return;
+
+        StatTimer timer(StatStage::Filesystem);
+        std::error_code error;
+        fs::remove(img.spill_path, error);
+        img.spill_path.clear();
+    }
+
+
+    // Releases the pixels of one image. Unmodified pixels can be decoded
+    // again from original_path; modified ones are written to a scratch file
+    // first. Queued ops stay queued either way.
+    bool evictImage(ImageData& img) {
+        if (img.modified) {
+            std::string spill_path = (fs::path(input_folder) /
+                (std::to_string(spill_counter++) + "_" + img.filename + ".raw")).string();
+
+            if (!writeSpillFile(img, spill_path)) {
+                reporter.error("Failed to spill " + img.filename + " to " + spill_path);
+                return false;
+            }
+            img.spill_path = spill_path;
+        }
+
+        img.pixels.reset();
+        return true;
+    }
+
+
+    // Evicts least recently used images until incoming_bytes more fit under
+    // the memory limit. Pinned images (the current working set) are never
+    // evicted, so a window larger than the limit still goes through.
+    void enforceMemoryLimit(size_t incoming_bytes, const std::vector<size_t>& pinned) {
+        if (memory_limit == 0) return;
+
+        size_t resident_bytes = getMemoryUsage();
+        if (resident_bytes + incoming_bytes <= memory_limit) return;
+
+        std::vector<char> is_pinned(loaded_images.size(), 0);
+        for (size_t slot : pinned) {
+            is_pinned[slot] = 1;
+        }
+
+        std::vector<size_t> candidates;
+        for (size_t i = 0; i < loaded_images.size(); i++) {
+            if (loaded_images[i].pixels && !is_pinned[i]) {
+                candidates.push_back(i);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [this](size_t a, size_t b) {
+            return loaded_images[a].last_used < loaded_images[b].last_used;
+        });
+
+        for (size_t slot : candidates) {
+            if (resident_bytes + incoming_bytes <= memory_limit) break;
+
+            ImageData& img = loaded_images[slot];
+            size_t freed_bytes = img.byteSize();
+            if (evictImage(img)) {
+                resident_bytes -= freed_bytes;
+            }
+        }
+    }
+
+
+    // Brings every listed image into memory: headers-only and evicted images
+    // are decoded again, spilled ones are read back from their scratch file.
+    // Room is made first by evicting other images if a memory limit is set.
+    // Returns the indices that now hold pixels; images that fail to load are
+    // reported and left out.
+    std::vector<size_t> makeResident(const std::vector<size_t>& indices) {
+        std::vector<size_t> missing;
+        size_t missing_bytes = 0;
+        for (size_t slot : indices) {
+            if (!loaded_images[slot].pixels) {
+                missing.push_back(slot);
+                missing_bytes += loaded_images[slot].byteSize();
+            }
+        }
+
+        if (!missing.empty()) {
+            enforceMemoryLimit(missing_bytes, indices);
+
+            std::vector<ImageData> decoded(missing.size());
+            std::vector<char> decode_ok(missing.size(), 0);
+            pool->parallelFor(missing.size(), [&](size_t i) {
+                const ImageData& img = loaded_images[missing[i]];
+                decode_ok[i] = img.spill_path.empty() ? decodeImage(img.original_path, decoded[i])
+                                                      : readSpillFile(img.spill_path, img.filename, decoded[i]);
+            });
+
+            for (size_t i = 0; i < missing.size(); i++) {
+                ImageData& img = loaded_images[missing[i]];
+
+                if (!decode_ok[i]) {
+                    reporter.error("Failed to load: " + img.original_path);
+                    continue;
+                }
+
+                img.width = decoded[i].width;
+                img.height = decoded[i].height;
+                img.channels = decoded[i].channels;
+                img.pixels = std::move(decoded[i].pixels);
+                discardSpillFile(img);
+            }
+        }
+
+        std::vector<size_t> resident;
+        for (size_t slot : indices) {
+            if (loaded_images[slot].pixels) {
+                loaded_images[slot].last_used = ++use_clock;
+                resident.push_back(slot);
+            }
+        }
+        return resident;
+    }
+
+
+    // Bytes an image needs while its queued ops run: its pixels plus the
+    // largest scratch buffer any of those ops allocates.
+    size_t workingBytes(const ImageData& img) const {
+        size_t scratch_bytes = 0;
+        for (const FilterOp& op : img.pending_ops) {
+            scratch_bytes = std::max(scratch_bytes, spatialScratchBytes(op, img));
+        }
+        return img.byteSize() + scratch_bytes;
+    }
+
+
+    // Runs fn(resident_indices) over indices in consecutive windows whose
+    // working size (pixels plus the scratch their queued ops need) fits the
+    // memory limit (at least one image per window), so bulk commands work on
+    // any number of images. Without a limit there is a single window.
+    template <typename WindowFn>
+    void forEachWindow(const std::vector<size_t>& indices, WindowFn&& fn) {
+        size_t window_start = 0;
+
+        while (window_start < indices.size()) {
+            size_t window_end = window_start + 1;
+            size_t window_bytes = workingBytes(loaded_images[indices[window_start]]);
+
+            while (window_end < indices.size()) {
+                size_t next_bytes = workingBytes(loaded_images[indices[window_end]]);
+                if (memory_limit > 0 && window_bytes + next_bytes > memory_limit) break;
+
+                window_bytes += next_bytes;
+                window_end++;
+            }
+
+            std::vector<size_t> window(indices.begin() + window_start, indices.begin() + window_end);
+            fn(makeResident(window));
+            window_start = window_end;
+        }
+    }
+
+
+    bool loadSingleImage(const std::string& file_path) {
+        ImageData img;
+
+        bool loaded = lazy_loading ? readImageHeader(file_path, img) : decodeImage(file_path, img);
+        if (!loaded) {
+            reporter.error("Failed to load: " + file_path);
+            return false;
+        }
+
+        addLoadedImage(std::move(img));
+        
+        return true;
+    }
+
+
+    static void appendBands(ImageData* img, std::vector<RowBand>& bands) {
+        size_t row_bytes = std::max<size_t>(1, static_cast<size_t>(img->width) * img->channels);
+        int rows_per_band = static_cast<int>(std::max<size_t>(1, BAND_BYTES / row_bytes));
+
+        for (int row = 0; row < img->height; row += rows_per_band) {
+            bands.push_back({img, row, std::min(rows_per_band, img->height - row)});
+        }
+    }
+
+
+    // Runs ops over one image in order. Each run of consecutive point ops
+    // goes band by band, every band through the whole run while it is still
+    // in cache; each spatial op is a separate whole-image pass. Bands and
+    // tiles run on pool when one is given, otherwise on the calling thread.
+    static void runOps(ImageData& img, const std::vector<FilterOp>& ops, ThreadPool* pool) {
+        size_t run_start = 0;
+
+        while (run_start < ops.size()) {
+            if (!ops[run_start].isPointOp()) {
+                applySpatialOp(ops[run_start], img, pool);
+                run_start++;
+                continue;
+            }
+
+            size_t run_end = run_start;
+            while (run_end < ops.size() && ops[run_end].isPointOp()) {
+                run_end++;
+            }
+
+            std::vector<RowBand> bands;
+            appendBands(&img, bands);
+
+            auto run_band = [&](size_t i) {
+                const RowBand& band = bands[i];
+                for (size_t k = run_start; k < run_end; k++) {
+                    TraceSpan span(ops[k].name(), img.filename, band.pixelCount());
+                    applyFilterOp(ops[k], band.data(), band.pixelCount(), img.channels);
+                }
+            };
+
+            if (pool) {
+                pool->parallelFor(bands.size(), run_band);
+            }
+            else {
+                for (size_t i = 0; i < bands.size(); i++) {
+                    run_band(i);
+                }
+            }
+            for (size_t k = run_start; k < run_end; k++) {
+                KernelTimer::countImage(statStageFor(ops[k]));
+            }
+            run_start = run_end;
+        }
+    }
+
+
+    static std::string toLower(std::string text) {
+        std::transform(text.begin(), text.end(), text.begin(), ::tolower);
+        return text;
+    }
+
+
+    // Every image goes through here so the filename index stays in sync.
+    // When two files share a name the first one loaded wins, as it did with
+    // the old linear search.
+    void addLoadedImage(ImageData&& img) {
+        img.last_used = ++use_clock;
+        image_index.emplace(img.filename, loaded_images.size());
+        loaded_images.push_back(std::move(img));
+    }
+
+
+    void rebuildIndex() {
+        image_index.clear();
+        for (size_t i = 0; i < loaded_images.size(); i++) {
+            image_index.emplace(loaded_images[i].filename, i);
+        }
+    }
+
+
+    // Drops every flagged image in one stable compaction pass, so clearing n
+    // images costs O(n) moves instead of one tail shift per erase.
+    size_t removeImages(const std::vector<char>& remove_flags) {
+        size_t kept = 0;
+
+        for (size_t i = 0; i < loaded_images.size(); i++) {
+            if (remove_flags[i]) {
+                discardSpillFile(loaded_images[i]);
+                continue;
+            }
+
+            if (kept != i) {
+                loaded_images[kept] = std::move(loaded_images[i]);
+            }
+            kept++;
+        }
+
+        size_t removed = loaded_images.size() - kept;
+        loaded_images.erase(loaded_images.begin() + kept, loaded_images.end());
+        rebuildIndex();
+
+        return removed;
+    }
+
+
+    // Returns the slot of the named image, or loaded_images.size() if absent.
+    size_t findImageIndex(const std::string& target_name) const {
+        auto it = image_index.find(toLower(target_name));
+        return (it != image_index.end()) ? it->second : loaded_images.size();
+    }
+
+
+    void recordOp(ImageData& img, const FilterOp& op) {
+        if (img.pending_ops.empty() || !img.pending_ops.back().absorb(op)) {
+            img.pending_ops.push_back(op);
+        }
+    }
+
+
+    // Runs every queued op of the given images. A chain of point ops costs
+    // one pass over memory no matter how many adjustments were recorded.
+    // Images run side by side and split their own bands and tiles, so one
+    // huge image and a batch of small ones both keep every thread busy.
+    // With keep_resident every listed image stays in memory afterwards, for
+    // callers that encode them next; otherwise only the window being
+    // filtered is safe from eviction.
+    void runPendingOps(const std::vector<size_t>& indices, bool keep_resident = false) {
+        std::vector<size_t> queued;
+        for (size_t slot : indices) {
+            if (!loaded_images[slot].pending_ops.empty()) {
+                queued.push_back(slot);
+            }
+        }
+
+        forEachWindow(queued, [&](const std::vector<size_t>& resident) {
+            std::vector<ImageData*> images;
+            size_t scratch_bytes = 0;
+            for (size_t slot : resident) {
+                images.push_back(&loaded_images[slot]);
+                scratch_bytes += workingBytes(loaded_images[slot]) - loaded_images[slot].byteSize();
+            }
+
+            // Spatial ops allocate their output (and blur intermediates)
+            // next to the source, so make room for those under the limit
+            // first.
+            enforceMemoryLimit(scratch_bytes, keep_resident ? indices : resident);
+
+            pool->parallelFor(images.size(), [&](size_t i) {
+                runOps(*images[i], images[i]->pending_ops, pool.get());
+            });
+
+            for (ImageData* img : images) {
+                img->pending_ops.clear();
+                img->modified = true;
+            }
+        });
+    }
+
+
+    ImageData* findImageByName(const std::string& target_name) {
+        size_t slot = findImageIndex(target_name);
+        return (slot < loaded_images.size()) ? &loaded_images[slot] : nullptr;
+    }
+
+
+    // Slots a command operates on: every image when target is empty,
+    // otherwise only the named one (or none if it is not loaded).
+    std::vector<size_t> selectImages(const std::string& target) const {
+        std::vector<size_t> indices;
+
+        if (target.empty()) {
+            indices.resize(loaded_images.size());
+            for (size_t i = 0; i < indices.size(); i++) {
+                indices[i] = i;
+            }
+        }
+        else {
+            size_t slot = findImageIndex(target);
+            if (slot < loaded_images.size()) {
+                indices.push_back(slot);
+            }
+        }
+
+        return indices;
+    }
+
+
+    // Encodes in the format of the image's original extension. Runs on pool
+    // and stage threads, so instead of printing it leaves the reason for a
+    // refused image in failure_reason for the caller to report.
+    static bool writeImageToFile(const ImageData& img, const std::string& output_path,
+                                 std::string& failure_reason) {
+        StatTimer timer(StatStage::Encode, img.byteSize());
+        TraceSpan span("encode", img.filename, static_cast<uint64_t>(img.width) * img.height);
+        fs::path original_path(img.original_path);
+        std::string ext = original_path.extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+        // stb's PNG and BMP writers size their buffers and headers with int,
+        // and JPEG stores 16-bit dimensions. Refuse what they would corrupt.
+        size_t encoded_bytes = img.byteSize() + 4 * static_cast<size_t>(img.height) + 1024;
+        if ((ext == ".png" || ext == ".bmp") && encoded_bytes > static_cast<size_t>(INT_MAX)) {
+            failure_reason = "too large for " + ext + ", 2 GB limit";
+            return false;
+        }
+        if ((ext == ".jpg" || ext == ".jpeg") && (img.width > 65535 || img.height > 65535)) {
+            failure_reason = "too large for JPEG, 65535 pixel limit";
+            return false;
+        }
+
+        if (ext == ".png") {
+            return stbi_write_png(output_path.c_str(), img.width, img.height,
+                                img.channels, img.pixels.get(), static_cast<int>(img.width * img.channels));
+        }
+        else if (ext == ".jpg" || ext == ".jpeg") {
+            return stbi_write_jpg(output_path.c_str(), img.width, img.height,
+                                img.channels, img.pixels.get(), 95);
+        }
+        else if (ext == ".bmp") {
+            return stbi_write_bmp(output_path.c_str(), img.width, img.height,
+                                img.channels, img.pixels.get());
+        }
+        
+        return false;
+    }
+
+    // Encodes the given images into out_dir concurrently. The result holds one
+    // success flag per index, and failure_reasons one reason per index, in the
+    // same order, so callers can still report per file in pipeline order. Images that share a filename (loaded from
+    // different folders) go to the same path, so they are written one after
+    // another on a single task and the last one in pipeline order wins.
+    std::vector<char> writeImagesToFolder(const std::vector<size_t>& indices, const fs::path& out_dir,
+                                          std::vector<std::string>& failure_reasons) {
+        std::vector<char> written(indices.size(), 0);
+        failure_reasons.assign(indices.size(), std::string());
+
+        std::vector<std::vector<size_t>> groups;
+        std::unordered_map<std::string, size_t> group_of_path;
+        for (size_t i = 0; i < indices.size(); i++) {
+            const std::string& filename = loaded_images[indices[i]].filename;
+            auto inserted = group_of_path.emplace(filename, groups.size());
+            if (inserted.second) {
+                groups.emplace_back();
+            }
+            groups[inserted.first->second].push_back(i);
+        }
+
+        pool->parallelFor(groups.size(), [&](size_t g) {
+            for (size_t i : groups[g]) {
+                const ImageData& img = loaded_images[indices[i]];
+                written[i] = writeImageToFile(img, (out_dir / img.filename).string(), failure_reasons[i]);
+            }
+        });
+
+        return written;
+    }
+
+public:
+    Pipeline() : base_folder("Morph"),
+                 input_folder("Morph/input"),
+                 output_folder("Morph/output"),
+                 defer_filters(false),
+                 lazy_loading(false),
+                 memory_limit(0),
+                 use_clock(0),
+                 spill_counter(0),
+                 decode_threads(0),
+                 filter_threads(0),
+                 encode_threads(0),
+                 border_mode(BorderMode::Clamp) {
+        createFolderStructure();
+        setThreadCount(std::thread::hardware_concurrency());
+    }
+
+
+    ~Pipeline() {
+        for (auto& img : loaded_images) {
+            discardSpillFile(img);
+        }
+    }
+
+
+    // Total threads used for parallel work, including the calling thread.
+    // A count of 0 picks one thread per hardware core.
+    void setThreadCount(unsigned int thread_count) {
+        if (thread_count == 0) {
+            thread_count = std::max(1u, std::thread::hardware_concurrency());
+        }
+        pool = std::make_unique<ThreadPool>(thread_count);
+    }
+
+
+    unsigned int getThreadCount() const {
+        return pool->size();
+    }
+
+
+    // In deferred mode filter commands are only recorded; preview and export
+    // run each image's queued chain in one fused pass. Turning it off runs
+    // whatever is still queued.
+    void setDeferredFilters(bool deferred) {
+        defer_filters = deferred;
+        if (!defer_filters) {
+            runPendingOps(selectImages(""));
+        }
+    }
+
+
+    bool getDeferredFilters() const {
+        return defer_filters;
+    }
+
+
+    // In lazy mode -i only reads image headers; pixels are decoded the first
+    // time a filter, preview or export needs them.
+    void setLazyLoading(bool lazy) {
+        lazy_loading = lazy;
+    }
+
+
+    bool getLazyLoading() const {
+        return lazy_loading;
+    }
+
+
+    // Caps the decoded pixels kept in memory. Past the cap the least recently
+    // used images are evicted: unmodified ones are decoded again when needed,
+    // modified ones are spilled to the input folder. 0 means no limit.
+    void setMemoryLimit(size_t limit_bytes) {
+        memory_limit = limit_bytes;
+        enforceMemoryLimit(0, {});
+
+        // Recycled buffers are memory too; keep them to a quarter of the cap.
+        size_t cache_limit = PixelAllocator::DEFAULT_CACHE_LIMIT;
+        if (memory_limit > 0) {
+            cache_limit = std::min(cache_limit, memory_limit / 4);
+        }
+        PixelAllocator::instance().setCacheLimit(cache_limit);
+    }
+
+
+    size_t getMemoryLimit() const {
+        return memory_limit;
+    }
+
+
+    // How much pipeline operations print; see ReportMode.
+    void setReportMode(ReportMode mode) {
+        reporter.setMode(mode);
+    }
+
+
+    ReportMode getReportMode() const {
+        return reporter.getMode();
+    }
+
+
+    // Transparent huge pages for large frames, where the OS supports them.
+    void setHugePages(bool enabled) {
+        PixelAllocator::instance().setHugePages(enabled);
+    }
+
+
+    bool getHugePages() const {
+        return PixelAllocator::instance().getHugePages();
+    }
+
+
+    // Edge handling for blur and sharpen commands issued from now on.
+    void setBorderMode(BorderMode mode) {
+        border_mode = mode;
+    }
+
+
+    BorderMode getBorderMode() const {
+        return border_mode;
+    }
+
+
+    // Single-image codec paths without any pipeline bookkeeping: what
+    // loadSingleImage and export run per file. Used by the benchmark.
+    static bool decodeFile(const std::string& file_path, ImageData& img) {
+        return decodeImage(file_path, img);
+    }
+
+
+    static bool encodeFile(const ImageData& img, const std::string& output_path) {
+        std::string failure_reason;
+        return writeImageToFile(img, output_path, failure_reason);
+    }
+
+
+    // Threads per streaming stage. 0 derives the count from the thread
+    // setting: about half decode, the rest mostly encode, since the filter
+    // stage is the cheapest by far.
+    void setStageThreads(unsigned int decode, unsigned int filter, unsigned int encode) {
+        decode_threads = decode;
+        filter_threads = filter;
+        encode_threads = encode;
+    }
+
+
+    void getStageThreads(unsigned int& decode, unsigned int& filter, unsigned int& encode) const {
+        unsigned int total = getThreadCount();
+        unsigned int auto_decode = std::max(1u, total / 2);
+        unsigned int auto_filter = std::max(1u, total / 8);
+        unsigned int auto_encode = (total > auto_decode + auto_filter) ? total - auto_decode - auto_filter : 1;
+
+        decode = decode_threads ? decode_threads : auto_decode;
+        filter = filter_threads ? filter_threads : auto_filter;
+        encode = encode_threads ? encode_threads : auto_encode;
+    }
+
+
+    bool addInput(const std::string& path) {
+        if (!fs::exists(path)) {
+            reporter.error("Path not found: " + path);
+            return false;
+        }
+
+        if (fs::is_regular_file(path)) {
+            std::string ext = fs::path(path).extension().string();
+            
+            if (!isValidImageFormat(ext)) {
+                reporter.error("Not a valid image file");
+                return false;
+            }
+
+            std::string filename = fs::path(path).filename().string();
+            reporter.info("Loading: " + filename);
+
+            if (loadSingleImage(path)) {
+                reporter.info("Added: " + filename);
+                return true;
+            }
+            return false;
+        }
+
+        if (!fs::is_directory(path)) {
+            reporter.error("Invalid path: " + path);
+            return false;
+        }
+
+        std::vector<std::string> image_paths = listImageFiles(path);
+
+        reporter.info(std::string(lazy_loading ? "Indexing " : "Loading ") + std::to_string(image_paths.size()) +
+                      " file(s) on " + std::to_string(getThreadCount()) + " thread(s)...");
+        reporter.beginStage("load", image_paths.size());
+
+        // Under a memory limit files are decoded a few per thread at a time,
+        // evicting older images between chunks, so the folder never has to
+        // fit in memory at once.
+        size_t chunk_size = image_paths.size();
+        if (memory_limit > 0 && !lazy_loading) {
+            chunk_size = std::max<size_t>(1, getThreadCount() * 2);
+        }
+
+        int count = 0;
+        size_t decoded_bytes = 0;
+        for (size_t chunk_start = 0; chunk_start < image_paths.size(); chunk_start += chunk_size) {
+            size_t chunk_count = std::min(chunk_size, image_paths.size() - chunk_start);
+
+            std::vector<ImageData> decoded(chunk_count);
+            std::vector<char> decode_ok(chunk_count, 0);
+            pool->parallelFor(chunk_count, [&](size_t i) {
+                const std::string& image_path = image_paths[chunk_start + i];
+                decode_ok[i] = lazy_loading ? readImageHeader(image_path, decoded[i])
+                                            : decodeImage(image_path, decoded[i]);
+            });
+
+            for (size_t i = 0; i < chunk_count; i++) {
+                if (!decode_ok[i]) {
+                    reporter.item(image_paths[chunk_start + i], ItemStatus::LoadFailed);
+                    continue;
+                }
+
+                const ImageData& img = decoded[i];
+                if (img.pixels) {
+                    decoded_bytes += img.byteSize();
+                }
+                reporter.item(img.filename, ItemStatus::Ok);
+
+                addLoadedImage(std::move(decoded[i]));
+                count++;
+            }
+
+            enforceMemoryLimit(0, {});
+        }
+
+        if (lazy_loading) {
+            reporter.endStage("Added " + std::to_string(count) + " image(s), headers only (decoded on first use),");
+        }
+        else {
+            reporter.endStage("Loaded " + std::to_string(count) + " image(s)", decoded_bytes);
+        }
+        return count > 0;
+    }
+
+
+    bool applyGrayscale(const std::string& target = "", double intensity = 100) {
+        intensity = std::max(0.0, std::min(100.0, intensity));
+
+        std::ostringstream label;
+        label << "grayscale (" << intensity << "%)";
+        return applyFilter(makeGrayscaleOp(intensity), label.str(), target);
+    }
+
+
+    // Runs op on the target image, or on every image when target is empty
+    // (queued instead with set defer on). label describes the op in
+    // messages, e.g. "blur 5 (50%)".
+    bool applyFilter(FilterOp op, const std::string& label, const std::string& target = "") {
+        if (loaded_images.empty()) {
+            reporter.error("No images in input. Use: -i @\"path\"");
+            return false;
+        }
+
+        op.border = border_mode;
+        std::vector<size_t> indices = selectImages(target);
+
+        if (indices.empty() && !target.empty()) {
+            reporter.error("Image not found in input: " + target);
+            return false;
+        }
+
+        for (size_t slot : indices) {
+            recordOp(loaded_images[slot], op);
+        }
+
+        if (defer_filters) {
+            reporter.info("Queued " + label + "...");
+            reporter.beginStage("queue", indices.size());
+            for (size_t slot : indices) {
+                reporter.item(loaded_images[slot].filename, ItemStatus::Queued);
+            }
+            reporter.endStage("Queued " + std::string(op.name()) + " for " +
+                              std::to_string(indices.size()) + " image(s)");
+            return true;
+        }
+
+        reporter.info("Applying " + label + "...");
+        reporter.beginStage(op.name(), indices.size());
+        runPendingOps(indices);
+
+        int processed_count = 0;
+        size_t processed_bytes = 0;
+        for (size_t slot : indices) {
+            if (loaded_images[slot].pending_ops.empty()) {
+                reporter.item(loaded_images[slot].filename, ItemStatus::Ok);
+                processed_count++;
+                processed_bytes += loaded_images[slot].byteSize();
+            }
+        }
+
+        std::string filter_name = op.name();
+        filter_name[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(filter_name[0])));
+        reporter.endStage(filter_name + " applied to " + std::to_string(processed_count) + " image(s)", processed_bytes);
+        return processed_count > 0 || indices.empty();
+    }
+
+
+    bool savePreview(const std::string& target = "") {
+        if (loaded_images.empty()) {
+            reporter.error("No images in input.");
+            return false;
+        }
+
+        reporter.info("Saving preview to: " + output_folder);
+
+        std::vector<size_t> selected = selectImages(target);
+        reporter.beginStage("preview", selected.size());
+
+        int saved_count = 0;
+        size_t saved_bytes = 0;
+        forEachWindow(selected, [&](const std::vector<size_t>& indices) {
+            runPendingOps(indices, true);
+            std::vector<std::string> failure_reasons;
+            std::vector<char> written = writeImagesToFolder(indices, output_folder, failure_reasons);
+
+            for (size_t i = 0; i < indices.size(); i++) {
+                const ImageData& img = loaded_images[indices[i]];
+
+                if (written[i]) {
+                    reporter.item(img.filename, ItemStatus::Ok);
+                    saved_count++;
+                    saved_bytes += img.byteSize();
+                }
+                else {
+                    reporter.item(img.filename, ItemStatus::Failed, failure_reasons[i]);
+                }
+            }
+        });
+
+        reporter.endStage("Saved " + std::to_string(saved_count) + " preview(s) to disk", saved_bytes);
+        return saved_count > 0;
+    }
+
+
+    bool exportOutput(const std::string& output_path, bool clear_input = true, const std::string& target = "") {
+        if (loaded_images.empty()) {
+            reporter.error("No images in input.");
+            return false;
+        }
+
+        fs::path out_dir(output_path);
+        if (!createOutputDirectory(out_dir)) {
+            return false;
+        }
+
+        reporter.info("Exporting to: " + output_path);
+
+        std::vector<size_t> selected = selectImages(target);
+        reporter.beginStage("export", selected.size());
+
+        std::vector<char> remove_flags(loaded_images.size(), 0);
+        int exported_count = 0;
+        size_t exported_bytes = 0;
+
+        forEachWindow(selected, [&](const std::vector<size_t>& indices) {
+            runPendingOps(indices, true);
+            std::vector<std::string> failure_reasons;
+            std::vector<char> written = writeImagesToFolder(indices, out_dir, failure_reasons);
+
+            for (size_t i = 0; i < indices.size(); i++) {
+                ImageData& img = loaded_images[indices[i]];
+
+                if (written[i]) {
+                    reporter.item(img.filename, ItemStatus::Ok);
+                    exported_count++;
+                    exported_bytes += img.byteSize();
+
+                    // Exported images are about to be cleared; freeing them
+                    // now keeps later windows from spilling them.
+                    if (clear_input) {
+                        remove_flags[indices[i]] = 1;
+                        img.pixels.reset();
+                    }
+                }
+                else {
+                    reporter.item(img.filename, ItemStatus::Failed, failure_reasons[i]);
+                }
+            }
+        });
+
+        reporter.endStage("Export complete! (" + std::to_string(exported_count) + " file(s))", exported_bytes);
+
+        if (clear_input && exported_count > 0) {
+            reporter.info("Clearing " + std::to_string(exported_count) + " image(s) from input...");
+            removeImages(remove_flags);
+            reporter.info("Input cleared!");
+        }
+
+        return exported_count > 0;
+    }
+
+
+    // Runs every image under input_paths (files or folders) through
+    // decode -> ops -> encode into output_path without adding it to the
+    // pipeline, like -i, @i and -o with clear would. The three stages run on
+    // their own threads, connected by bounded queues, so decoding, filtering
+    // and encoding overlap and at most a few images per stage thread are in
+    // memory, however many files there are. Results are reported in input
+    // order as they complete, followed by each stage's utilization. The
+    // stages run on plain threads, so each one catches its own exceptions
+    // and reports the image as failed instead of ending the process.
+    bool streamImages(const std::vector<std::string>& input_paths, const std::vector<FilterOp>& recorded_ops,
+                      const std::string& output_path) {
+        std::vector<std::string> image_paths;
+        for (const std::string& path : input_paths) {
+            if (!fs::exists(path)) {
+                reporter.error("Path not found: " + path);
+                return false;
+            }
+
+            if (fs::is_directory(path)) {
+                std::vector<std::string> folder_paths = listImageFiles(path);
+                image_paths.insert(image_paths.end(), folder_paths.begin(), folder_paths.end());
+            }
+            else if (isValidImageFormat(fs::path(path).extension().string())) {
+                image_paths.push_back(path);
+            }
+            else {
+                reporter.error("Not a valid image file: " + path);
+                return false;
+            }
+        }
+
+        fs::path out_dir(output_path);
+        if (!createOutputDirectory(out_dir)) {
+            return false;
+        }
+
+        // Ops fuse exactly as they would in the pipeline.
+        std::vector<FilterOp> ops;
+        for (const FilterOp& op : recorded_ops) {
+            FilterOp stamped = op;
+            stamped.border = border_mode;
+            if (!defer_filters || ops.empty() || !ops.back().absorb(stamped)) {
+                ops.push_back(stamped);
+            }
+        }
+
+        unsigned int decode_count, filter_count, encode_count;
+        getStageThreads(decode_count, filter_count, encode_count);
+        StageStats decode_stats("decode", decode_count);
+        StageStats filter_stats("filter", filter_count);
+        StageStats encode_stats("encode", encode_count);
+
+        reporter.info("Streaming " + std::to_string(image_paths.size()) + " file(s) to " + output_path +
+                      " (decode " + std::to_string(decode_count) + ", filter " + std::to_string(filter_count) +
+                      ", encode " + std::to_string(encode_count) + " thread(s))...");
+        reporter.beginStage("stream", image_paths.size());
+
+        enum StreamResult : char { Pending, LoadFailed, WriteFailed, Written };
+        size_t file_count = image_paths.size();
+        std::vector<char> results(file_count, Pending);
+        std::vector<std::string> filenames(file_count);
+        std::vector<size_t> image_bytes(file_count, 0);
+        std::vector<std::string> failure_reasons(file_count);
+        std::mutex results_mutex;
+        std::condition_variable result_ready;
+
+        auto finish = [&](size_t index, StreamResult result) {
+            {
+                std::lock_guard<std::mutex> lock(results_mutex);
+                results[index] = result;
+            }
+            result_ready.notify_one();
+        };
+
+        BoundedQueue<StreamItem> decoded_queue(2 * filter_count);
+        BoundedQueue<StreamItem> filtered_queue(2 * encode_count);
+        std::atomic<size_t> next_file(0);
+        std::atomic<unsigned int> decoders_running(decode_count);
+        std::atomic<unsigned int> filters_running(filter_count);
+        std::vector<std::thread> stage_threads;
+
+        for (unsigned int t = 0; t < decode_count; t++) {
+            stage_threads.emplace_back([&]() {
+                StreamItem item;
+                for (size_t i = next_file++; i < file_count; i = next_file++) {
+                    auto decode_start = std::chrono::steady_clock::now();
+                    bool decoded = false;
+                    try {
+                        decoded = decodeImage(image_paths[i], item.image);
+                    }
+                    catch (const std::exception&) {
+                        item.image.pixels.reset();
+                    }
+                    decode_stats.record(decode_start);
+
+                    if (!decoded) {
+                        finish(i, LoadFailed);
+                        continue;
+                    }
+
+                    filenames[i] = item.image.filename;
+                    image_bytes[i] = item.image.byteSize();
+                    item.file_index = i;
+                    decoded_queue.push(std::move(item));
+                }
+
+                if (--decoders_running == 0) {
+                    decoded_queue.close();
+                }
+            });
+        }
+
+        for (unsigned int t = 0; t < filter_count; t++) {
+            stage_threads.emplace_back([&]() {
+                StreamItem item;
+                while (decoded_queue.pop(item)) {
+                    auto filter_start = std::chrono::steady_clock::now();
+                    bool filtered = true;
+                    try {
+                        runOps(item.image, ops, nullptr);
+                    }
+                    catch (const std::exception&) {
+                        filtered = false;
+                    }
+                    filter_stats.record(filter_start);
+
+                    if (!filtered) {
+                        item.image.pixels.reset();
+                        finish(item.file_index, WriteFailed);
+                        continue;
+                    }
+                    filtered_queue.push(std::move(item));
+                }
+
+                if (--filters_running == 0) {
+                    filtered_queue.close();
+                }
+            });
+        }
+
+        for (unsigned int t = 0; t < encode_count; t++) {
+            stage_threads.emplace_back([&]() {
+                StreamItem item;
+                while (filtered_queue.pop(item)) {
+                    auto encode_start = std::chrono::steady_clock::now();
+                    bool written = false;
+                    try {
+                        written = writeImageToFile(item.image, (out_dir / item.image.filename).string(),
+                                                   failure_reasons[item.file_index]);
+                    }
+                    catch (const std::exception&) {
+                        written = false;
+                    }
+                    item.image.pixels.reset();
+                    encode_stats.record(encode_start);
+
+                    finish(item.file_index, written ? Written : WriteFailed);
+                }
+            });
+        }
+
+        int written_count = 0;
+        size_t decoded_bytes = 0;
+        for (size_t i = 0; i < file_count; i++) {
+            char result;
+            {
+                std::unique_lock<std::mutex> lock(results_mutex);
+                result_ready.wait(lock, [&] { return results[i] != Pending; });
+                result = results[i];
+            }
+
+            if (result == LoadFailed) {
+                reporter.item(image_paths[i], ItemStatus::LoadFailed);
+                continue;
+            }
+
+            decoded_bytes += image_bytes[i];
+            if (result == Written) {
+                reporter.item(filenames[i], ItemStatus::Ok);
+                written_count++;
+            }
+            else {
+                reporter.item(filenames[i], ItemStatus::Failed, failure_reasons[i]);
+            }
+        }
+
+        for (auto& stage_thread : stage_threads) {
+            stage_thread.join();
+        }
+
+        double elapsed_seconds = reporter.endStage("Streamed " + std::to_string(written_count) + " image(s)",
+                                                   decoded_bytes);
+
+        // The busiest stage, relative to its thread count, is the one holding
+        // the others back; give it more threads with set stages.
+        const StageStats* stages[] = {&decode_stats, &filter_stats, &encode_stats};
+        const StageStats* bottleneck = stages[0];
+        double bottleneck_busy = -1.0;
+
+        reporter.summary("Stage utilization:");
+        for (const StageStats* stage : stages) {
+            double available_ns = elapsed_seconds * 1e9 * stage->threads;
+            double busy = (available_ns > 0.0) ? stage->busy_ns.load() / available_ns : 0.0;
+            if (busy > bottleneck_busy) {
+                bottleneck = stage;
+                bottleneck_busy = busy;
+            }
+
+            reporter.summary("  " + std::string(stage->name) + ": " + std::to_string(std::lround(busy * 100.0)) +
+                             "% busy on " + std::to_string(stage->threads) + " thread(s), " +
+                             std::to_string(stage->items.load()) + " image(s)");
+        }
+        if (file_count > 0) {
+            reporter.summary("Bottleneck: " + std::string(bottleneck->name));
+        }
+
+        return written_count > 0;
+    }
+
+
+    void listInput() const {
+        if (loaded_images.empty()) {
+            std::cout << "No images in input." << std::endl;
+            return;
+        }
+
+        size_t resident_count = 0;
+        for (const auto& img : loaded_images) {
+            if (img.pixels) resident_count++;
+        }
+
+        std::cout << "Images in input (" << loaded_images.size() << ", "
+                  << resident_count << " resident):" << std::endl;
+        
+        for (const auto& img : loaded_images) {
+            std::string status = img.pixels ? "" : (img.spill_path.empty() ? " [NOT LOADED]" : " [SPILLED]");
+            if (img.modified) status += " [MODIFIED]";
+            if (!img.pending_ops.empty()) {
+                status += " [" + std::to_string(img.pending_ops.size()) + " QUEUED]";
+            }
+            double size_in_mb = img.byteSize() / (1024.0 * 1024.0);
+            
+            std::cout << "  - " << img.filename 
+                     << " (" << img.width << "x" << img.height << ", " << size_in_mb << " MB)" 
+                     << status << '\n';
+        }
+        std::cout << std::flush;
+    }
+
+
+    // Per-stage counters since start or the last resetStats: a table in
+    // normal and summary mode, one JSON event in progress mode.
+    void showStats() {
+        const Stats& stats = Stats::instance();
+        if (reporter.getMode() == ReportMode::Progress) {
+            reporter.event(stats.formatJson());
+            return;
+        }
+
+        for (const std::string& line : stats.formatTable()) {
+            reporter.summary(line);
+        }
+    }
+
+
+    void resetStats() {
+        Stats::instance().reset();
+    }
+
+
+    // Records decode, filter, encode and spill spans until stopTrace, then
+    // writes them as Chrome Trace Event JSON (open in Perfetto or
+    // chrome://tracing). A trace already running is written out first.
+    bool startTrace(const std::string& trace_path) {
+        if (!stopTrace()) return false;
+
+        if (!std::ofstream(trace_path)) {
+            reporter.error("Cannot write trace file: " + trace_path);
+            return false;
+        }
+
+        TraceRecorder::instance().start(trace_path);
+        return true;
+    }
+
+
+    bool stopTrace() {
+        TraceRecorder& recorder = TraceRecorder::instance();
+        if (!recorder.isEnabled()) return true;
+
+        long long span_count = recorder.stop();
+        if (span_count < 0) {
+            reporter.error("Failed to write trace: " + recorder.getOutputPath());
+            return false;
+        }
+
+        reporter.summary("Trace written: " + std::to_string(span_count) + " span(s) to " + recorder.getOutputPath());
+        return true;
+    }
+
+
+    size_t getMemoryUsage() const {
+        size_t total_bytes = 0;
+        for (const auto& img : loaded_images) {
+            if (!img.pixels) continue;
+            total_bytes += img.byteSize();
+        }
+        return total_bytes;
+    }
+};
+
+#endif
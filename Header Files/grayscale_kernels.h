@@ -0,0 +1,354 @@
+#ifndef GRAYSCALE_KERNELS_H
+#define GRAYSCALE_KERNELS_H
+
+#include <cstddef>
+#include "cpu_features.h"
+#include "pixel_layout.h"
+
+// Fixed-point BT.601 weights (0.299, 0.587, 0.114) scaled by 256. They sum to
+// exactly 256, so a pixel that is already gray maps to itself.
+const int GRAY_RED_WEIGHT = 77;
+const int GRAY_GREEN_WEIGHT = 150;
+const int GRAY_BLUE_WEIGHT = 29;
+
+// Blend weights are in 1/256 steps: 0 keeps the original, 256 is full gray.
+//   gray = (77 R + 150 G + 29 B + 128) >> 8
+//   out  = (c * (256 - blend) + gray * blend + 128) >> 8
+// Every intermediate fits in 16 bits, which is what the vector kernels use.
+// All variants produce bit-identical output.
+
+
+struct GrayscaleOp {
+    int blend_weight;
+
+    template <typename Layout>
+    void apply(unsigned char* p) const {
+        static_assert(!Layout::is_gray, "gray pixels need no conversion");
+        const int keep_weight = 256 - blend_weight;
+        int gray = (GRAY_RED_WEIGHT * p[0] + GRAY_GREEN_WEIGHT * p[1] + GRAY_BLUE_WEIGHT * p[2] + 128) >> 8;
+
+        p[0] = static_cast<unsigned char>((p[0] * keep_weight + gray * blend_weight + 128) >> 8);
+        p[1] = static_cast<unsigned char>((p[1] * keep_weight + gray * blend_weight + 128) >> 8);
+        p[2] = static_cast<unsigned char>((p[2] * keep_weight + gray * blend_weight + 128) >> 8);
+    }
+};
+
+
+#ifdef MORPH_X86
+
+// The vector kernels work on 16-bit lanes laid out as two RGBX pixels per
+// 128-bit lane. Every operation stays inside its 128-bit lane, so the AVX2
+// and AVX-512 versions are the SSE2 version repeated 2 or 4 times. Each
+// kernel returns how many leading pixels it handled; the scalar kernel does
+// the rest.
+
+MORPH_TARGET_SSE2
+inline __m128i grayscaleBlendSSE2(__m128i rgbx, __m128i weights, __m128i keep, __m128i mix) {
+    __m128i sums = _mm_madd_epi16(rgbx, weights);
+    sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, _MM_SHUFFLE(2, 3, 0, 1)));
+    __m128i gray = _mm_srli_epi32(_mm_add_epi32(sums, _mm_set1_epi32(128)), 8);
+    gray = _mm_shufflehi_epi16(_mm_shufflelo_epi16(gray, 0), 0);
+
+    __m128i blended = _mm_add_epi16(_mm_mullo_epi16(rgbx, keep), _mm_mullo_epi16(gray, mix));
+    return _mm_srli_epi16(_mm_add_epi16(blended, _mm_set1_epi16(128)), 8);
+}
+
+
+// RGB data is handled in 48-byte blocks of 16 pixels: three loads, four
+// groups of four pixels in the low 12 bytes of a vector each, three stores.
+// Loads and stores never overlap, so nothing waits on store forwarding.
+MORPH_TARGET_SSE2
+inline void splitRGBBlockSSE2(const unsigned char* p, __m128i quads[4]) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+    __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32));
+    quads[0] = a;
+    quads[1] = _mm_or_si128(_mm_srli_si128(a, 12), _mm_slli_si128(b, 4));
+    quads[2] = _mm_or_si128(_mm_srli_si128(b, 8), _mm_slli_si128(c, 8));
+    quads[3] = _mm_srli_si128(c, 4);
+}
+
+
+// Inverse of splitRGBBlockSSE2; the top 4 bytes of every quad are ignored.
+MORPH_TARGET_SSE2
+inline void joinRGBBlockSSE2(const __m128i quads[4], unsigned char* p) {
+    const __m128i low_12 = _mm_setr_epi32(-1, -1, -1, 0);
+    const __m128i low_8 = _mm_setr_epi32(-1, -1, 0, 0);
+    const __m128i low_4 = _mm_setr_epi32(-1, 0, 0, 0);
+    __m128i a = _mm_or_si128(_mm_and_si128(quads[0], low_12), _mm_slli_si128(quads[1], 12));
+    __m128i b = _mm_or_si128(_mm_and_si128(_mm_srli_si128(quads[1], 4), low_8), _mm_slli_si128(quads[2], 8));
+    __m128i c = _mm_or_si128(_mm_and_si128(_mm_srli_si128(quads[2], 8), low_4), _mm_slli_si128(quads[3], 4));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), a);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p + 16), b);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p + 32), c);
+}
+
+
+template <typename Layout>
+MORPH_TARGET_SSE2
+inline size_t grayscaleSSE2(unsigned char* pixels, size_t pixel_count, int blend_weight) {
+    const short b = static_cast<short>(blend_weight);
+    const short k = static_cast<short>(256 - blend_weight);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weights = _mm_setr_epi16(GRAY_RED_WEIGHT, GRAY_GREEN_WEIGHT, GRAY_BLUE_WEIGHT, 0,
+                                           GRAY_RED_WEIGHT, GRAY_GREEN_WEIGHT, GRAY_BLUE_WEIGHT, 0);
+    const __m128i keep = _mm_setr_epi16(k, k, k, 256, k, k, k, 256);
+    const __m128i mix = _mm_setr_epi16(b, b, b, 0, b, b, b, 0);
+
+    size_t pixel = 0;
+
+    if constexpr (Layout::channels == 4) {
+        for (; pixel + 4 <= pixel_count; pixel += 4) {
+            __m128i* p = reinterpret_cast<__m128i*>(pixels + pixel * 4);
+            __m128i v = _mm_loadu_si128(p);
+            __m128i lo = grayscaleBlendSSE2(_mm_unpacklo_epi8(v, zero), weights, keep, mix);
+            __m128i hi = grayscaleBlendSSE2(_mm_unpackhi_epi8(v, zero), weights, keep, mix);
+            _mm_storeu_si128(p, _mm_packus_epi16(lo, hi));
+        }
+    }
+    else {
+        const __m128i lanes_012 = _mm_setr_epi16(-1, -1, -1, 0, 0, 0, 0, 0);
+        const __m128i lanes_456 = _mm_setr_epi16(0, 0, 0, 0, -1, -1, -1, 0);
+        const __m128i lanes_345 = _mm_setr_epi16(0, 0, 0, -1, -1, -1, 0, 0);
+        const __m128i lane_2 = _mm_setr_epi16(0, 0, -1, 0, 0, 0, 0, 0);
+        const __m128i lane_0 = _mm_setr_epi16(-1, 0, 0, 0, 0, 0, 0, 0);
+        const __m128i lanes_123 = _mm_setr_epi16(0, -1, -1, -1, 0, 0, 0, 0);
+
+        for (; pixel + 16 <= pixel_count; pixel += 16) {
+            unsigned char* p = pixels + pixel * 3;
+            __m128i quads[4];
+            splitRGBBlockSSE2(p, quads);
+
+            for (__m128i& v : quads) {
+                __m128i lo = _mm_unpacklo_epi8(v, zero);
+                __m128i hi = _mm_unpackhi_epi8(v, zero);
+
+                __m128i rgbx01 = _mm_or_si128(_mm_and_si128(lo, lanes_012),
+                                              _mm_and_si128(_mm_slli_si128(lo, 2), lanes_456));
+                __m128i rgbx23 = _mm_or_si128(_mm_srli_si128(lo, 12),
+                                 _mm_or_si128(_mm_and_si128(_mm_slli_si128(hi, 4), lane_2),
+                                              _mm_and_si128(_mm_slli_si128(hi, 6), lanes_456)));
+
+                rgbx01 = grayscaleBlendSSE2(rgbx01, weights, keep, mix);
+                rgbx23 = grayscaleBlendSSE2(rgbx23, weights, keep, mix);
+
+                __m128i out_lo = _mm_or_si128(_mm_and_si128(rgbx01, lanes_012),
+                                 _mm_or_si128(_mm_and_si128(_mm_srli_si128(rgbx01, 2), lanes_345),
+                                              _mm_slli_si128(rgbx23, 12)));
+                __m128i out_hi = _mm_or_si128(_mm_and_si128(_mm_srli_si128(rgbx23, 4), lane_0),
+                                              _mm_and_si128(_mm_srli_si128(rgbx23, 6), lanes_123));
+                v = _mm_packus_epi16(out_lo, out_hi);
+            }
+
+            joinRGBBlockSSE2(quads, p);
+        }
+    }
+
+    return pixel;
+}
+
+
+MORPH_TARGET_AVX2
+inline __m256i grayscaleBlendAVX2(__m256i rgbx, __m256i weights, __m256i keep, __m256i mix) {
+    __m256i sums = _mm256_madd_epi16(rgbx, weights);
+    sums = _mm256_add_epi32(sums, _mm256_shuffle_epi32(sums, _MM_SHUFFLE(2, 3, 0, 1)));
+    __m256i gray = _mm256_srli_epi32(_mm256_add_epi32(sums, _mm256_set1_epi32(128)), 8);
+    gray = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(gray, 0), 0);
+
+    __m256i blended = _mm256_add_epi16(_mm256_mullo_epi16(rgbx, keep), _mm256_mullo_epi16(gray, mix));
+    return _mm256_srli_epi16(_mm256_add_epi16(blended, _mm256_set1_epi16(128)), 8);
+}
+
+
+template <typename Layout>
+MORPH_TARGET_AVX2
+inline size_t grayscaleAVX2(unsigned char* pixels, size_t pixel_count, int blend_weight) {
+    const short b = static_cast<short>(blend_weight);
+    const short k = static_cast<short>(256 - blend_weight);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i weights = _mm256_broadcastsi128_si256(_mm_setr_epi16(
+        GRAY_RED_WEIGHT, GRAY_GREEN_WEIGHT, GRAY_BLUE_WEIGHT, 0,
+        GRAY_RED_WEIGHT, GRAY_GREEN_WEIGHT, GRAY_BLUE_WEIGHT, 0));
+    const __m256i keep = _mm256_broadcastsi128_si256(_mm_setr_epi16(k, k, k, 256, k, k, k, 256));
+    const __m256i mix = _mm256_broadcastsi128_si256(_mm_setr_epi16(b, b, b, 0, b, b, b, 0));
+
+    size_t pixel = 0;
+
+    if constexpr (Layout::channels == 4) {
+        for (; pixel + 8 <= pixel_count; pixel += 8) {
+            __m256i* p = reinterpret_cast<__m256i*>(pixels + pixel * 4);
+            __m256i v = _mm256_loadu_si256(p);
+            __m256i lo = grayscaleBlendAVX2(_mm256_unpacklo_epi8(v, zero), weights, keep, mix);
+            __m256i hi = grayscaleBlendAVX2(_mm256_unpackhi_epi8(v, zero), weights, keep, mix);
+            _mm256_storeu_si256(p, _mm256_packus_epi16(lo, hi));
+        }
+    }
+    else {
+        const __m256i lanes_012 = _mm256_broadcastsi128_si256(_mm_setr_epi16(-1, -1, -1, 0, 0, 0, 0, 0));
+        const __m256i lanes_456 = _mm256_broadcastsi128_si256(_mm_setr_epi16(0, 0, 0, 0, -1, -1, -1, 0));
+        const __m256i lanes_345 = _mm256_broadcastsi128_si256(_mm_setr_epi16(0, 0, 0, -1, -1, -1, 0, 0));
+        const __m256i lane_2 = _mm256_broadcastsi128_si256(_mm_setr_epi16(0, 0, -1, 0, 0, 0, 0, 0));
+        const __m256i lane_0 = _mm256_broadcastsi128_si256(_mm_setr_epi16(-1, 0, 0, 0, 0, 0, 0, 0));
+        const __m256i lanes_123 = _mm256_broadcastsi128_si256(_mm_setr_epi16(0, -1, -1, -1, 0, 0, 0, 0));
+
+        // Sixteen RGB pixels per step, two groups of four per register.
+        for (; pixel + 16 <= pixel_count; pixel += 16) {
+            unsigned char* p = pixels + pixel * 3;
+            __m128i quads[4];
+            splitRGBBlockSSE2(p, quads);
+
+            for (int half = 0; half < 2; half++) {
+                __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(quads[half * 2]), quads[half * 2 + 1], 1);
+                __m256i lo = _mm256_unpacklo_epi8(v, zero);
+                __m256i hi = _mm256_unpackhi_epi8(v, zero);
+
+                __m256i rgbx01 = _mm256_or_si256(_mm256_and_si256(lo, lanes_012),
+                                                 _mm256_and_si256(_mm256_slli_si256(lo, 2), lanes_456));
+                __m256i rgbx23 = _mm256_or_si256(_mm256_srli_si256(lo, 12),
+                                 _mm256_or_si256(_mm256_and_si256(_mm256_slli_si256(hi, 4), lane_2),
+                                                 _mm256_and_si256(_mm256_slli_si256(hi, 6), lanes_456)));
+
+                rgbx01 = grayscaleBlendAVX2(rgbx01, weights, keep, mix);
+                rgbx23 = grayscaleBlendAVX2(rgbx23, weights, keep, mix);
+
+                __m256i out_lo = _mm256_or_si256(_mm256_and_si256(rgbx01, lanes_012),
+                                 _mm256_or_si256(_mm256_and_si256(_mm256_srli_si256(rgbx01, 2), lanes_345),
+                                                 _mm256_slli_si256(rgbx23, 12)));
+                __m256i out_hi = _mm256_or_si256(_mm256_and_si256(_mm256_srli_si256(rgbx23, 4), lane_0),
+                                                 _mm256_and_si256(_mm256_srli_si256(rgbx23, 6), lanes_123));
+                __m256i out = _mm256_packus_epi16(out_lo, out_hi);
+                quads[half * 2] = _mm256_castsi256_si128(out);
+                quads[half * 2 + 1] = _mm256_extracti128_si256(out, 1);
+            }
+
+            joinRGBBlockSSE2(quads, p);
+        }
+    }
+
+    return pixel;
+}
+
+
+MORPH_TARGET_AVX512
+inline __m512i grayscaleBlendAVX512(__m512i rgbx, __m512i weights, __m512i keep, __m512i mix) {
+    __m512i sums = _mm512_madd_epi16(rgbx, weights);
+    sums = _mm512_add_epi32(sums, _mm512_shuffle_epi32(sums, _MM_PERM_CDAB));
+    __m512i gray = _mm512_srli_epi32(_mm512_add_epi32(sums, _mm512_set1_epi32(128)), 8);
+    gray = _mm512_shufflehi_epi16(_mm512_shufflelo_epi16(gray, 0), 0);
+
+    __m512i blended = _mm512_add_epi16(_mm512_mullo_epi16(rgbx, keep), _mm512_mullo_epi16(gray, mix));
+    return _mm512_srli_epi16(_mm512_add_epi16(blended, _mm512_set1_epi16(128)), 8);
+}
+
+
+template <typename Layout>
+MORPH_TARGET_AVX512
+inline size_t grayscaleAVX512(unsigned char* pixels, size_t pixel_count, int blend_weight) {
+    const short b = static_cast<short>(blend_weight);
+    const short k = static_cast<short>(256 - blend_weight);
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i weights = _mm512_broadcast_i32x4(_mm_setr_epi16(
+        GRAY_RED_WEIGHT, GRAY_GREEN_WEIGHT, GRAY_BLUE_WEIGHT, 0,
+        GRAY_RED_WEIGHT, GRAY_GREEN_WEIGHT, GRAY_BLUE_WEIGHT, 0));
+    const __m512i keep = _mm512_broadcast_i32x4(_mm_setr_epi16(k, k, k, 256, k, k, k, 256));
+    const __m512i mix = _mm512_broadcast_i32x4(_mm_setr_epi16(b, b, b, 0, b, b, b, 0));
+
+    size_t pixel = 0;
+
+    if constexpr (Layout::channels == 4) {
+        for (; pixel + 16 <= pixel_count; pixel += 16) {
+            unsigned char* p = pixels + pixel * 4;
+            __m512i v = _mm512_loadu_si512(p);
+            __m512i lo = grayscaleBlendAVX512(_mm512_unpacklo_epi8(v, zero), weights, keep, mix);
+            __m512i hi = grayscaleBlendAVX512(_mm512_unpackhi_epi8(v, zero), weights, keep, mix);
+            _mm512_storeu_si512(p, _mm512_packus_epi16(lo, hi));
+        }
+    }
+    else {
+        const __m512i lanes_012 = _mm512_broadcast_i32x4(_mm_setr_epi16(-1, -1, -1, 0, 0, 0, 0, 0));
+        const __m512i lanes_456 = _mm512_broadcast_i32x4(_mm_setr_epi16(0, 0, 0, 0, -1, -1, -1, 0));
+        const __m512i lanes_345 = _mm512_broadcast_i32x4(_mm_setr_epi16(0, 0, 0, -1, -1, -1, 0, 0));
+        const __m512i lane_2 = _mm512_broadcast_i32x4(_mm_setr_epi16(0, 0, -1, 0, 0, 0, 0, 0));
+        const __m512i lane_0 = _mm512_broadcast_i32x4(_mm_setr_epi16(-1, 0, 0, 0, 0, 0, 0, 0));
+        const __m512i lanes_123 = _mm512_broadcast_i32x4(_mm_setr_epi16(0, -1, -1, -1, 0, 0, 0, 0));
+
+        // Sixteen RGB pixels per step, one group of four per 128-bit lane.
+        for (; pixel + 16 <= pixel_count; pixel += 16) {
+            unsigned char* p = pixels + pixel * 3;
+            __m128i quads[4];
+            splitRGBBlockSSE2(p, quads);
+
+            __m512i v = _mm512_castsi128_si512(quads[0]);
+            v = _mm512_inserti32x4(v, quads[1], 1);
+            v = _mm512_inserti32x4(v, quads[2], 2);
+            v = _mm512_inserti32x4(v, quads[3], 3);
+            __m512i lo = _mm512_unpacklo_epi8(v, zero);
+            __m512i hi = _mm512_unpackhi_epi8(v, zero);
+
+            __m512i rgbx01 = _mm512_or_si512(_mm512_and_si512(lo, lanes_012),
+                                             _mm512_and_si512(_mm512_bslli_epi128(lo, 2), lanes_456));
+            __m512i rgbx23 = _mm512_or_si512(_mm512_bsrli_epi128(lo, 12),
+                             _mm512_or_si512(_mm512_and_si512(_mm512_bslli_epi128(hi, 4), lane_2),
+                                             _mm512_and_si512(_mm512_bslli_epi128(hi, 6), lanes_456)));
+
+            rgbx01 = grayscaleBlendAVX512(rgbx01, weights, keep, mix);
+            rgbx23 = grayscaleBlendAVX512(rgbx23, weights, keep, mix);
+
+            __m512i out_lo = _mm512_or_si512(_mm512_and_si512(rgbx01, lanes_012),
+                             _mm512_or_si512(_mm512_and_si512(_mm512_bsrli_epi128(rgbx01, 2), lanes_345),
+                                             _mm512_bslli_epi128(rgbx23, 12)));
+            __m512i out_hi = _mm512_or_si512(_mm512_and_si512(_mm512_bsrli_epi128(rgbx23, 4), lane_0),
+                                             _mm512_and_si512(_mm512_bsrli_epi128(rgbx23, 6), lanes_123));
+            __m512i out = _mm512_packus_epi16(out_lo, out_hi);
+            quads[0] = _mm512_castsi512_si128(out);
+            quads[1] = _mm512_extracti32x4_epi32(out, 1);
+            quads[2] = _mm512_extracti32x4_epi32(out, 2);
+            quads[3] = _mm512_extracti32x4_epi32(out, 3);
+
+            joinRGBBlockSSE2(quads, p);
+        }
+    }
+
+    return pixel;
+}
+
+#endif
+
+
+// Converts pixel_count interleaved pixels in place. One- and two-channel
+// images are already gray, so only RGB and RGBA data is touched; alpha is
+// always preserved.
+inline void grayscalePixels(unsigned char* pixels, size_t pixel_count, int channels, int blend_weight,
+                            SimdLevel level = simdLevel()) {
+    if (blend_weight <= 0) return;
+
+    dispatchLayout(channels, [&](auto layout) {
+        using Layout = decltype(layout);
+
+        if constexpr (!Layout::is_gray) {
+            size_t done = 0;
+
+#ifdef MORPH_X86
+            switch (level) {
+                case SimdLevel::AVX512:
+                    done = grayscaleAVX512<Layout>(pixels, pixel_count, blend_weight);
+                    break;
+                case SimdLevel::AVX2:
+                    done = grayscaleAVX2<Layout>(pixels, pixel_count, blend_weight);
+                    break;
+                case SimdLevel::SSE2:
+                    done = grayscaleSSE2<Layout>(pixels, pixel_count, blend_weight);
+                    break;
+                default:
+                    break;
+            }
+#else
+            (void)level;
+#endif
+
+            forEachPixel<Layout>(pixels + done * Layout::channels, pixel_count - done, GrayscaleOp{blend_weight});
+        }
+    });
+}
+
+#endif
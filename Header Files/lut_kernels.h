@@ -0,0 +1,178 @@
+#ifndef LUT_KERNELS_H
+#define LUT_KERNELS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+#include "cpu_features.h"
+#include "pixel_layout.h"
+
+
+// A tone curve on 8-bit values: entry i is the new value of every color
+// channel that held i. Alpha is never looked up. Brightness, contrast,
+// gamma, levels and invert all compile to one of these, and a chain of them
+// composes into a single table.
+struct PointLut {
+    unsigned char table[256];
+
+    // The table for this curve followed by next.
+    PointLut then(const PointLut& next) const {
+        PointLut lut;
+        for (int i = 0; i < 256; i++) {
+            lut.table[i] = next.table[table[i]];
+        }
+        return lut;
+    }
+};
+
+
+// Samples curve, a function from 0-1 to 0-1, at each 8-bit value. Results
+// outside the range are clamped.
+template <typename Curve>
+PointLut makePointLut(Curve&& curve) {
+    PointLut lut;
+    for (int i = 0; i < 256; i++) {
+        double value = std::max(0.0, std::min(1.0, static_cast<double>(curve(i / 255.0))));
+        lut.table[i] = static_cast<unsigned char>(std::lround(value * 255.0));
+    }
+    return lut;
+}
+
+
+struct LookupOp {
+    const unsigned char* table;
+
+    template <typename Layout>
+    void apply(unsigned char* p) const {
+        for (int c = 0; c < Layout::color_channels; c++) {
+            p[c] = table[p[c]];
+        }
+    }
+};
+
+
+#ifdef MORPH_X86
+
+// The vector kernels look up every byte and then restore the alpha bytes,
+// which sit at fixed offsets because a register holds whole 2- and 4-byte
+// pixels. Each returns how many leading pixels it handled; the scalar
+// kernel does the rest. SSE2 has no byte shuffle, so it uses the scalar
+// kernel.
+
+// AVX2: vpshufb looks up the low nibble within one 16-entry row of the
+// table, and blends on the four high bits pick the row. The tree is walked
+// depth first, so only a few partial results are live at once.
+// selects[b] holds bit 4 + b of every byte in its top bit, which is the bit
+// blendv reads.
+template <int Bits>
+MORPH_TARGET_AVX2
+inline __m256i lookupRowsAVX2(const __m256i* rows, __m256i index, const __m256i* selects) {
+    if constexpr (Bits == 0) {
+        (void)selects;
+        return _mm256_shuffle_epi8(rows[0], index);
+    }
+    else {
+        __m256i lower = lookupRowsAVX2<Bits - 1>(rows, index, selects);
+        __m256i upper = lookupRowsAVX2<Bits - 1>(rows + (1 << (Bits - 1)), index, selects);
+        return _mm256_blendv_epi8(lower, upper, selects[Bits - 1]);
+    }
+}
+
+
+template <typename Layout>
+MORPH_TARGET_AVX2
+inline size_t lookupAVX2(unsigned char* pixels, size_t pixel_count, const unsigned char* table) {
+    __m256i rows[16];
+    for (int row = 0; row < 16; row++) {
+        rows[row] = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(table + row * 16)));
+    }
+    const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+    const __m256i alpha = (Layout::channels == 4) ? _mm256_set1_epi32(static_cast<int>(0xFF000000u))
+                                                  : _mm256_set1_epi16(static_cast<short>(0xFF00));
+
+    const size_t byte_count = pixel_count * Layout::channels;
+    size_t done = 0;
+
+    for (; done + 32 <= byte_count; done += 32) {
+        __m256i* p = reinterpret_cast<__m256i*>(pixels + done);
+        __m256i v = _mm256_loadu_si256(p);
+        const __m256i selects[4] = {_mm256_slli_epi16(v, 3), _mm256_slli_epi16(v, 2), _mm256_slli_epi16(v, 1), v};
+
+        __m256i out = lookupRowsAVX2<4>(rows, _mm256_and_si256(v, low_nibble), selects);
+        if constexpr (Layout::has_alpha) {
+            out = _mm256_blendv_epi8(out, v, alpha);
+        }
+        _mm256_storeu_si256(p, out);
+    }
+
+    return done / Layout::channels;
+}
+
+
+// AVX-512 VBMI: vpermi2b looks up 128 entries from two registers, so the
+// whole table is two permutes and a blend on the top bit per 64 bytes.
+template <typename Layout>
+MORPH_TARGET_AVX512_VBMI
+inline size_t lookupAVX512(unsigned char* pixels, size_t pixel_count, const unsigned char* table) {
+    const __m512i table_0 = _mm512_loadu_si512(table);
+    const __m512i table_1 = _mm512_loadu_si512(table + 64);
+    const __m512i table_2 = _mm512_loadu_si512(table + 128);
+    const __m512i table_3 = _mm512_loadu_si512(table + 192);
+    const __mmask64 alpha = (Layout::channels == 4) ? 0x8888888888888888ull : 0xAAAAAAAAAAAAAAAAull;
+
+    const size_t byte_count = pixel_count * Layout::channels;
+    size_t done = 0;
+
+    for (; done + 64 <= byte_count; done += 64) {
+        unsigned char* p = pixels + done;
+        __m512i v = _mm512_loadu_si512(p);
+        __m512i lower = _mm512_permutex2var_epi8(table_0, v, table_1);
+        __m512i upper = _mm512_permutex2var_epi8(table_2, v, table_3);
+        __m512i out = _mm512_mask_blend_epi8(_mm512_movepi8_mask(v), lower, upper);
+
+        if constexpr (Layout::has_alpha) {
+            out = _mm512_mask_blend_epi8(alpha, out, v);
+        }
+        _mm512_storeu_si512(p, out);
+    }
+
+    return done / Layout::channels;
+}
+
+#endif
+
+
+// Maps the color channels of pixel_count interleaved pixels through lut in
+// place; alpha is preserved. Gray and RGB data is looked up byte by byte,
+// so no layout needs its own vector kernel.
+inline void lookupPixels(unsigned char* pixels, size_t pixel_count, int channels, const PointLut& lut,
+                         SimdLevel level = simdLevel()) {
+    dispatchLayout(channels, [&](auto layout) {
+        using Layout = decltype(layout);
+        // Without alpha every byte is a color value: treat it as gray.
+        using Bytes = std::conditional_t<Layout::has_alpha, Layout, PixelLayout<1>>;
+        const size_t count = Layout::has_alpha ? pixel_count : pixel_count * Layout::channels;
+        size_t done = 0;
+
+#ifdef MORPH_X86
+        switch (level) {
+            case SimdLevel::AVX512:
+                done = hasAvx512Vbmi() ? lookupAVX512<Bytes>(pixels, count, lut.table)
+                                       : lookupAVX2<Bytes>(pixels, count, lut.table);
+                break;
+            case SimdLevel::AVX2:
+                done = lookupAVX2<Bytes>(pixels, count, lut.table);
+                break;
+            default:
+                break;
+        }
+#else
+        (void)level;
+#endif
+
+        forEachPixel<Bytes>(pixels + done * Bytes::channels, count - done, LookupOp{lut.table});
+    });
+}
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+// Read-only view of a whole file. Decoders read straight from the page cache
+// instead of copying through stdio buffers. The mapping is released by
+// close() or the destructor.
+class MappedFile {
+private:
+    const unsigned char* view;
+    size_t length;
+#ifdef _WIN32
+    HANDLE file_handle;
+    HANDLE mapping_handle;
+#endif
+
+public:
+    MappedFile() : view(nullptr), length(0)
+#ifdef _WIN32
+                 , file_handle(INVALID_HANDLE_VALUE), mapping_handle(nullptr)
+#endif
+    {}
+
+    ~MappedFile() {
+        close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+
+    // Maps the file and hints that it will be read once, front to back.
+    // Returns false for empty files or when mapping is not possible; callers
+    // fall back to regular reads.
+    bool open(const std::string& path) {
+        close();
+
+#ifdef _WIN32
+        file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file_handle == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0) {
+            close();
+            return false;
+        }
+
+        mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping_handle) {
+            close();
+            return false;
+        }
+
+        view = static_cast<const unsigned char*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+        if (!view) {
+            close();
+            return false;
+        }
+        length = static_cast<size_t>(file_size.QuadPart);
+#else
+        int descriptor = ::open(path.c_str(), O_RDONLY);
+        if (descriptor < 0) return false;
+
+        struct stat file_info;
+        if (fstat(descriptor, &file_info) != 0 || file_info.st_size <= 0) {
+            ::close(descriptor);
+            return false;
+        }
+
+        size_t file_size = static_cast<size_t>(file_info.st_size);
+        void* mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        ::close(descriptor);
+
+        if (mapping == MAP_FAILED) return false;
+
+        madvise(mapping, file_size, MADV_SEQUENTIAL);
+        madvise(mapping, file_size, MADV_WILLNEED);
+        view = static_cast<const unsigned char*>(mapping);
+        length = file_size;
+#endif
+        return true;
+    }
+
+
+    void close() {
+#ifdef _WIN32
+        if (view) UnmapViewOfFile(view);
+        if (mapping_handle) CloseHandle(mapping_handle);
+        if (file_handle != INVALID_HANDLE_VALUE) CloseHandle(file_handle);
+        mapping_handle = nullptr;
+        file_handle = INVALID_HANDLE_VALUE;
+#else
+        if (view) munmap(const_cast<unsigned char*>(view), length);
+#endif
+        view = nullptr;
+        length = 0;
+    }
+
+
+    const unsigned char* data() const {
+        return view;
+    }
+
+
+    size_t size() const {
+        return length;
+    }
+};
+
+#endif
@@ -0,0 +1,243 @@
+#ifndef PIXEL_ALLOCATOR_H
+#define PIXEL_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+
+// Size-class pool for pixel buffers. Decoding a folder, clearing it and
+// loading the next one would otherwise send every multi-megabyte frame back
+// through the general heap (and usually mmap/munmap); here freed blocks are
+// kept per size class and handed to the next image of similar size.
+//
+// Every block is 64-byte aligned, so SIMD kernels may use aligned loads on
+// row starts of aligned widths. Small blocks (stb's scratch allocations)
+// get the same alignment but are not cached.
+class PixelAllocator {
+public:
+    static const size_t ALIGNMENT = 64;
+    static const size_t HUGE_PAGE_BYTES = 2 * 1024 * 1024;
+    static const size_t DEFAULT_CACHE_LIMIT = 256 * 1024 * 1024;
+
+private:
+    // Below this size blocks go straight back to the heap.
+    static const size_t MIN_POOLED_BYTES = 64 * 1024;
+    // Four classes per power of two, so a block wastes at most a quarter.
+    static const int STEPS_PER_DOUBLING = 4;
+    static const int DOUBLINGS = 15;
+
+    // Stored in the ALIGNMENT bytes in front of every block, so free and
+    // realloc know the capacity without a lookup.
+    struct BlockHeader {
+        size_t capacity;
+        int size_class;
+    };
+
+    std::mutex mutex;
+    std::vector<size_t> class_capacities;
+    std::vector<std::vector<unsigned char*>> free_blocks;
+    size_t cached_bytes;
+    size_t cache_limit;
+    bool huge_pages;
+
+
+    PixelAllocator() : cached_bytes(0), cache_limit(DEFAULT_CACHE_LIMIT), huge_pages(false) {
+        size_t base = MIN_POOLED_BYTES;
+        for (int doubling = 0; doubling < DOUBLINGS; doubling++) {
+            for (int step = 0; step < STEPS_PER_DOUBLING; step++) {
+                class_capacities.push_back(base + base * step / STEPS_PER_DOUBLING);
+            }
+            base *= 2;
+        }
+        free_blocks.resize(class_capacities.size());
+    }
+
+
+    // Smallest class that fits byte_count, or -1 for sizes that are not pooled.
+    int sizeClass(size_t byte_count) const {
+        if (byte_count < MIN_POOLED_BYTES) return -1;
+
+        auto it = std::lower_bound(class_capacities.begin(), class_capacities.end(), byte_count);
+        return (it != class_capacities.end()) ? static_cast<int>(it - class_capacities.begin()) : -1;
+    }
+
+
+    static unsigned char* alignedAlloc(size_t byte_count, size_t alignment) {
+#ifdef _WIN32
+        return static_cast<unsigned char*>(_aligned_malloc(byte_count, alignment));
+#else
+        void* block = nullptr;
+        return (posix_memalign(&block, alignment, byte_count) == 0) ? static_cast<unsigned char*>(block) : nullptr;
+#endif
+    }
+
+
+    static void alignedFree(unsigned char* block) {
+#ifdef _WIN32
+        _aligned_free(block);
+#else
+        std::free(block);
+#endif
+    }
+
+
+    static BlockHeader* headerOf(void* pointer) {
+        return reinterpret_cast<BlockHeader*>(static_cast<unsigned char*>(pointer) - ALIGNMENT);
+    }
+
+public:
+    PixelAllocator(const PixelAllocator&) = delete;
+    PixelAllocator& operator=(const PixelAllocator&) = delete;
+
+
+    ~PixelAllocator() {
+        trim();
+    }
+
+
+    static PixelAllocator& instance() {
+        static PixelAllocator allocator;
+        return allocator;
+    }
+
+
+    void* allocate(size_t byte_count) {
+        int size_class = sizeClass(byte_count);
+        size_t capacity = (size_class >= 0) ? class_capacities[size_class] : byte_count;
+
+        if (size_class >= 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::vector<unsigned char*>& blocks = free_blocks[size_class];
+            if (!blocks.empty()) {
+                unsigned char* block = blocks.back();
+                blocks.pop_back();
+                cached_bytes -= capacity;
+                return block + ALIGNMENT;
+            }
+        }
+
+        // Frames of a few huge pages or more start on a huge page boundary
+        // so the kernel can back them with 2 MB pages.
+        size_t total_bytes = capacity + ALIGNMENT;
+        bool use_huge_pages = huge_pages && total_bytes >= 2 * HUGE_PAGE_BYTES;
+        unsigned char* block = alignedAlloc(total_bytes, use_huge_pages ? HUGE_PAGE_BYTES : ALIGNMENT);
+        if (!block) return nullptr;
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        if (use_huge_pages) {
+            madvise(block, total_bytes, MADV_HUGEPAGE);
+        }
+#endif
+
+        BlockHeader* header = reinterpret_cast<BlockHeader*>(block);
+        header->capacity = capacity;
+        header->size_class = size_class;
+        return block + ALIGNMENT;
+    }
+
+
+    void release(void* pointer) {
+        if (!pointer) return;
+
+        BlockHeader* header = headerOf(pointer);
+        unsigned char* block = reinterpret_cast<unsigned char*>(header);
+
+        if (header->size_class >= 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (cached_bytes + header->capacity <= cache_limit) {
+                free_blocks[header->size_class].push_back(block);
+                cached_bytes += header->capacity;
+                return;
+            }
+        }
+
+        alignedFree(block);
+    }
+
+
+    // Growing within the block's size class keeps the same block, which
+    // covers most of stb's incremental zlib buffer growth.
+    void* reallocate(void* pointer, size_t byte_count) {
+        if (!pointer) return allocate(byte_count);
+
+        size_t capacity = headerOf(pointer)->capacity;
+        if (byte_count <= capacity) return pointer;
+
+        void* grown = allocate(byte_count);
+        if (!grown) return nullptr;
+
+        std::memcpy(grown, pointer, capacity);
+        release(pointer);
+        return grown;
+    }
+
+
+    // Returns every cached block to the heap.
+    void trim() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& blocks : free_blocks) {
+            for (unsigned char* block : blocks) {
+                alignedFree(block);
+            }
+            blocks.clear();
+        }
+        cached_bytes = 0;
+    }
+
+
+    // Upper bound on freed bytes kept for reuse; 0 disables caching.
+    void setCacheLimit(size_t limit_bytes) {
+        bool over_limit;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            cache_limit = limit_bytes;
+            over_limit = cached_bytes > cache_limit;
+        }
+        if (over_limit) {
+            trim();
+        }
+    }
+
+
+    // Asks for transparent huge pages on large frames (Linux only; a no-op
+    // elsewhere). Fewer TLB misses when filters sweep whole frames.
+    void setHugePages(bool enabled) {
+        std::lock_guard<std::mutex> lock(mutex);
+        huge_pages = enabled;
+    }
+
+
+    bool getHugePages() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return huge_pages;
+    }
+};
+
+
+// Entry points for STBI_MALLOC, STBI_REALLOC and STBI_FREE, so stb's output
+// buffers come from the pool too (see stb_config.h).
+inline void* pixelMalloc(size_t byte_count) {
+    return PixelAllocator::instance().allocate(byte_count);
+}
+
+
+inline void* pixelRealloc(void* pointer, size_t byte_count) {
+    return PixelAllocator::instance().reallocate(pointer, byte_count);
+}
+
+
+inline void pixelFree(void* pointer) {
+    PixelAllocator::instance().release(pointer);
+}
+
+#endif
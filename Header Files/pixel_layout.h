@@ -0,0 +1,50 @@
+#ifndef PIXEL_LAYOUT_H
+#define PIXEL_LAYOUT_H
+
+#include <cstddef>
+
+
+// Compile-time description of an interleaved 8-bit pixel. stb hands out
+// 1 (gray), 2 (gray + alpha), 3 (RGB) or 4 (RGBA) channels.
+template <int Channels>
+struct PixelLayout {
+    static constexpr int channels = Channels;
+    static constexpr bool has_alpha = (Channels == 2 || Channels == 4);
+    static constexpr int color_channels = has_alpha ? Channels - 1 : Channels;
+    static constexpr bool is_gray = (color_channels == 1);
+};
+
+
+// Calls fn(PixelLayout<N>{}) for the layout matching a runtime channel count,
+// so the body is compiled once per layout with no per-pixel channel checks.
+// Returns false for channel counts stb never produces.
+template <typename Fn>
+bool dispatchLayout(int channels, Fn&& fn) {
+    switch (channels) {
+        case 1: fn(PixelLayout<1>{}); return true;
+        case 2: fn(PixelLayout<2>{}); return true;
+        case 3: fn(PixelLayout<3>{}); return true;
+        case 4: fn(PixelLayout<4>{}); return true;
+        default: return false;
+    }
+}
+
+
+// Per-pixel filters are functors with a template call operator:
+//
+//     struct InvertOp {
+//         template <typename Layout>
+//         void apply(unsigned char* pixel) const { ... }
+//     };
+//
+// forEachPixel runs the scalar loop for a layout chosen by dispatchLayout;
+// the functor decides what to do with alpha and gray pixels through
+// Layout's constants.
+template <typename Layout, typename PixelOp>
+void forEachPixel(unsigned char* pixels, size_t pixel_count, const PixelOp& op) {
+    for (size_t pixel = 0; pixel < pixel_count; pixel++) {
+        op.template apply<Layout>(pixels + pixel * Layout::channels);
+    }
+}
+
+#endif
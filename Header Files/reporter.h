@@ -0,0 +1,247 @@
+#ifndef REPORTER_H
+#define REPORTER_H
+
+#include <string>
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <cstdio>
+
+
+enum class ReportMode {
+    Normal,     // narrative, one line per file, stage summaries
+    Quiet,      // errors only
+    Summary,    // errors and stage summaries
+    Progress    // JSON lines on stdout for job runners, errors included
+};
+
+
+enum class ItemStatus {
+    Ok,
+    Queued,
+    Failed,
+    LoadFailed
+};
+
+
+inline const char* reportModeName(ReportMode mode) {
+    switch (mode) {
+        case ReportMode::Quiet: return "quiet";
+        case ReportMode::Summary: return "summary";
+        case ReportMode::Progress: return "progress";
+        default: return "normal";
+    }
+}
+
+
+// Console output for pipeline operations. Per-file lines are collected in
+// a buffer while a stage runs and written in large blocks, instead of one
+// flushed write per file; errors flush the buffer first so output stays in
+// order. Used from the thread that drives the pipeline only.
+//
+// Progress mode emits one JSON object per line:
+//   {"event":"item","stage":"export","done":3,"total":24,"file":"a.png","status":"ok"}
+//   {"event":"stage","stage":"export","done":24,"total":24,"failed":0,"seconds":0.41,"bytes":52428800}
+//   {"event":"error","message":"..."}
+// Item lines are flushed at most every PROGRESS_INTERVAL so a runner sees
+// steady progress without a write per file.
+class Reporter {
+private:
+    static const size_t FLUSH_BYTES = 64 * 1024;
+    static constexpr std::chrono::milliseconds PROGRESS_INTERVAL{200};
+
+    ReportMode mode;
+    std::string buffer;
+    bool in_stage;
+    std::string stage_name;
+    size_t stage_total;
+    size_t stage_done;
+    size_t stage_failed;
+    std::chrono::steady_clock::time_point stage_start;
+    std::chrono::steady_clock::time_point last_flush;
+
+
+    static std::string jsonString(const std::string& text) {
+        std::string quoted = "\"";
+        for (char c : text) {
+            switch (c) {
+                case '"': quoted += "\\\""; break;
+                case '\\': quoted += "\\\\"; break;
+                case '\n': quoted += "\\n"; break;
+                case '\r': quoted += "\\r"; break;
+                case '\t': quoted += "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        char escaped[8];
+                        std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                        quoted += escaped;
+                    }
+                    else {
+                        quoted += c;
+                    }
+            }
+        }
+        return quoted + "\"";
+    }
+
+
+    static const char* statusName(ItemStatus status) {
+        switch (status) {
+            case ItemStatus::Queued: return "queued";
+            case ItemStatus::Failed: return "fail";
+            case ItemStatus::LoadFailed: return "load_fail";
+            default: return "ok";
+        }
+    }
+
+
+    // Outside a stage nothing is hot, so lines go out immediately.
+    void write(const std::string& line) {
+        buffer += line;
+        buffer += '\n';
+
+        if (!in_stage || buffer.size() >= FLUSH_BYTES) {
+            flush();
+        }
+        else if (mode == ReportMode::Progress &&
+                 std::chrono::steady_clock::now() - last_flush >= PROGRESS_INTERVAL) {
+            flush();
+        }
+    }
+
+public:
+    Reporter() : mode(ReportMode::Normal), in_stage(false), stage_total(0), stage_done(0), stage_failed(0) {}
+
+    ~Reporter() {
+        flush();
+    }
+
+    Reporter(const Reporter&) = delete;
+    Reporter& operator=(const Reporter&) = delete;
+
+
+    void setMode(ReportMode report_mode) {
+        flush();
+        mode = report_mode;
+    }
+
+
+    ReportMode getMode() const {
+        return mode;
+    }
+
+
+    void flush() {
+        if (!buffer.empty()) {
+            std::cout.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            buffer.clear();
+        }
+        std::cout.flush();
+        last_flush = std::chrono::steady_clock::now();
+    }
+
+
+    // Narrative lines ("Exporting to: ..."); normal mode only.
+    void info(const std::string& line) {
+        if (mode == ReportMode::Normal) {
+            write(line);
+        }
+    }
+
+
+    // Aggregate lines that summary mode keeps.
+    void summary(const std::string& line) {
+        if (mode == ReportMode::Normal || mode == ReportMode::Summary) {
+            write(line);
+        }
+    }
+
+
+    void error(const std::string& line) {
+        if (mode == ReportMode::Progress) {
+            write("{\"event\":\"error\",\"message\":" + jsonString(line) + "}");
+            return;
+        }
+
+        flush();
+        std::cerr << line << std::endl;
+    }
+
+
+    // A ready-made JSON object; progress mode only.
+    void event(const std::string& json_line) {
+        if (mode == ReportMode::Progress) {
+            write(json_line);
+        }
+    }
+
+
+    void beginStage(const std::string& name, size_t total) {
+        in_stage = true;
+        stage_name = name;
+        stage_total = total;
+        stage_done = 0;
+        stage_failed = 0;
+        stage_start = std::chrono::steady_clock::now();
+    }
+
+
+    // reason, when given, says why an item failed.
+    void item(const std::string& name, ItemStatus status, const std::string& reason = "") {
+        stage_done++;
+        if (status == ItemStatus::Failed || status == ItemStatus::LoadFailed) {
+            stage_failed++;
+        }
+
+        if (mode == ReportMode::Progress) {
+            std::ostringstream line;
+            line << "{\"event\":\"item\",\"stage\":" << jsonString(stage_name) << ",\"done\":" << stage_done
+                 << ",\"total\":" << stage_total << ",\"file\":" << jsonString(name)
+                 << ",\"status\":\"" << statusName(status) << "\"";
+            if (!reason.empty()) {
+                line << ",\"reason\":" << jsonString(reason);
+            }
+            line << "}";
+            write(line.str());
+            return;
+        }
+
+        std::string suffix = reason.empty() ? "" : " (" + reason + ")";
+        switch (status) {
+            case ItemStatus::Ok: info("[OK] " + name); break;
+            case ItemStatus::Queued: info("[QUEUED] " + name); break;
+            case ItemStatus::Failed: error("[FAIL] " + name + suffix); break;
+            case ItemStatus::LoadFailed: error("Failed to load: " + name + suffix); break;
+        }
+    }
+
+
+    // Closes the stage with "<summary> in X ms (Y MB/s)"; the rate is left
+    // out when no pixel bytes were involved. Returns the elapsed seconds.
+    double endStage(const std::string& summary_text, size_t bytes = 0) {
+        double elapsed_seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - stage_start).count();
+
+        if (mode == ReportMode::Progress) {
+            std::ostringstream line;
+            line << "{\"event\":\"stage\",\"stage\":" << jsonString(stage_name) << ",\"done\":" << stage_done
+                 << ",\"total\":" << stage_total << ",\"failed\":" << stage_failed
+                 << ",\"seconds\":" << elapsed_seconds << ",\"bytes\":" << bytes << "}";
+            write(line.str());
+        }
+        else {
+            std::ostringstream line;
+            line << summary_text << " in " << elapsed_seconds * 1000.0 << " ms";
+            if (bytes > 0 && elapsed_seconds > 0.0) {
+                line << " (" << bytes / (1024.0 * 1024.0) / elapsed_seconds << " MB/s)";
+            }
+            summary(line.str());
+        }
+
+        in_stage = false;
+        flush();
+        return elapsed_seconds;
+    }
+};
+
+#endif
@@ -0,0 +1,272 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+
+// Where pipeline time goes. Decode and encode are the codec calls and each
+// filter counts one item per image it ran on (all tone adjustments share
+// adjust); filesystem covers directory listing and creation, header probes
+// and spill files.
+enum class StatStage {
+    Decode,
+    Grayscale,
+    Adjust,
+    Blur,
+    Sharpen,
+    Encode,
+    Filesystem,
+    Count
+};
+
+
+inline const char* statStageName(StatStage stage) {
+    switch (stage) {
+        case StatStage::Decode: return "decode";
+        case StatStage::Grayscale: return "grayscale";
+        case StatStage::Adjust: return "adjust";
+        case StatStage::Blur: return "blur";
+        case StatStage::Sharpen: return "sharpen";
+        case StatStage::Encode: return "encode";
+        case StatStage::Filesystem: return "filesystem";
+        default: return "unknown";
+    }
+}
+
+
+// CPU time consumed by the calling thread, in nanoseconds.
+inline uint64_t threadCpuNanoseconds() {
+#ifdef _WIN32
+    FILETIME creation_time, exit_time, kernel_time, user_time;
+    if (!GetThreadTimes(GetCurrentThread(), &creation_time, &exit_time, &kernel_time, &user_time)) {
+        return 0;
+    }
+    auto ticks = [](const FILETIME& time) {
+        return (static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+    };
+    return (ticks(kernel_time) + ticks(user_time)) * 100;
+#else
+    timespec now;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0) {
+        return 0;
+    }
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + static_cast<uint64_t>(now.tv_nsec);
+#endif
+}
+
+
+// Process-wide counters per stage. Recording is four relaxed atomic adds,
+// and every stage sits on its own cache line, so worker threads timing
+// different stages do not contend. Times are summed over all threads, so
+// with N workers a stage can report up to N times the elapsed time.
+class Stats {
+public:
+    struct Totals {
+        uint64_t wall_ns;
+        uint64_t cpu_ns;
+        uint64_t bytes;
+        uint64_t items;
+    };
+
+private:
+    static const size_t STAGE_COUNT = static_cast<size_t>(StatStage::Count);
+
+    struct alignas(64) Counters {
+        std::atomic<uint64_t> wall_ns{0};
+        std::atomic<uint64_t> cpu_ns{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> items{0};
+    };
+
+    std::array<Counters, STAGE_COUNT> counters;
+    std::chrono::steady_clock::time_point start_time;
+
+
+    Stats() : start_time(std::chrono::steady_clock::now()) {}
+
+public:
+    Stats(const Stats&) = delete;
+    Stats& operator=(const Stats&) = delete;
+
+
+    static Stats& instance() {
+        static Stats stats;
+        return stats;
+    }
+
+
+    void record(StatStage stage, uint64_t wall_ns, uint64_t cpu_ns, uint64_t bytes, uint64_t items) {
+        Counters& stage_counters = counters[static_cast<size_t>(stage)];
+        stage_counters.wall_ns.fetch_add(wall_ns, std::memory_order_relaxed);
+        stage_counters.cpu_ns.fetch_add(cpu_ns, std::memory_order_relaxed);
+        stage_counters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+        stage_counters.items.fetch_add(items, std::memory_order_relaxed);
+    }
+
+
+    Totals totals(StatStage stage) const {
+        const Counters& stage_counters = counters[static_cast<size_t>(stage)];
+        return {stage_counters.wall_ns.load(std::memory_order_relaxed),
+                stage_counters.cpu_ns.load(std::memory_order_relaxed),
+                stage_counters.bytes.load(std::memory_order_relaxed),
+                stage_counters.items.load(std::memory_order_relaxed)};
+    }
+
+
+    bool empty() const {
+        for (size_t i = 0; i < STAGE_COUNT; i++) {
+            if (totals(static_cast<StatStage>(i)).items > 0) return false;
+        }
+        return true;
+    }
+
+
+    double elapsedSeconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    }
+
+
+    void reset() {
+        for (Counters& stage_counters : counters) {
+            stage_counters.wall_ns.store(0, std::memory_order_relaxed);
+            stage_counters.cpu_ns.store(0, std::memory_order_relaxed);
+            stage_counters.bytes.store(0, std::memory_order_relaxed);
+            stage_counters.items.store(0, std::memory_order_relaxed);
+        }
+        start_time = std::chrono::steady_clock::now();
+    }
+
+
+    // Table of the stages that recorded anything, one line per entry.
+    std::vector<std::string> formatTable() const {
+        std::vector<std::string> lines;
+        char line[160];
+
+        std::snprintf(line, sizeof(line), "Stats over %.2f s (times summed across threads):", elapsedSeconds());
+        lines.push_back(line);
+        std::snprintf(line, sizeof(line), "  %-12s %10s %12s %12s %12s %10s",
+                      "stage", "items", "wall ms", "cpu ms", "MB", "MB/s");
+        lines.push_back(line);
+
+        for (size_t i = 0; i < STAGE_COUNT; i++) {
+            StatStage stage = static_cast<StatStage>(i);
+            Totals stage_totals = totals(stage);
+            if (stage_totals.items == 0) continue;
+
+            double wall_ms = stage_totals.wall_ns / 1e6;
+            double megabytes = stage_totals.bytes / (1024.0 * 1024.0);
+            double rate = (stage_totals.wall_ns > 0) ? megabytes / (stage_totals.wall_ns / 1e9) : 0.0;
+            std::snprintf(line, sizeof(line), "  %-12s %10llu %12.1f %12.1f %12.1f %10.1f",
+                          statStageName(stage), static_cast<unsigned long long>(stage_totals.items),
+                          wall_ms, stage_totals.cpu_ns / 1e6, megabytes, rate);
+            lines.push_back(line);
+        }
+        return lines;
+    }
+
+
+    // One JSON object for progress mode:
+    //   {"event":"stats","seconds":1.2,"stages":{"decode":{"items":24,"wall_ms":...},...}}
+    std::string formatJson() const {
+        std::string json = "{\"event\":\"stats\",\"seconds\":" + std::to_string(elapsedSeconds()) + ",\"stages\":{";
+        bool first = true;
+
+        for (size_t i = 0; i < STAGE_COUNT; i++) {
+            StatStage stage = static_cast<StatStage>(i);
+            Totals stage_totals = totals(stage);
+            if (stage_totals.items == 0) continue;
+
+            json += first ? "\"" : ",\"";
+            json += statStageName(stage);
+            json += "\":{\"items\":" + std::to_string(stage_totals.items) +
+                    ",\"wall_ms\":" + std::to_string(stage_totals.wall_ns / 1e6) +
+                    ",\"cpu_ms\":" + std::to_string(stage_totals.cpu_ns / 1e6) +
+                    ",\"bytes\":" + std::to_string(stage_totals.bytes) + "}";
+            first = false;
+        }
+        return json + "}}";
+    }
+};
+
+
+// Times one operation from construction to destruction and adds it to its
+// stage. Bytes that are only known afterwards (a decoded image) can be set
+// before the timer goes out of scope.
+class StatTimer {
+private:
+    StatStage stage;
+    uint64_t bytes;
+    std::chrono::steady_clock::time_point wall_start;
+    uint64_t cpu_start;
+
+public:
+    explicit StatTimer(StatStage timed_stage, uint64_t byte_count = 0)
+        : stage(timed_stage), bytes(byte_count), wall_start(std::chrono::steady_clock::now()),
+          cpu_start(threadCpuNanoseconds()) {}
+
+    ~StatTimer() {
+        uint64_t cpu_ns = threadCpuNanoseconds() - cpu_start;
+        auto wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - wall_start).count();
+        Stats::instance().record(stage, static_cast<uint64_t>(wall_ns), cpu_ns, bytes, 1);
+    }
+
+    StatTimer(const StatTimer&) = delete;
+    StatTimer& operator=(const StatTimer&) = delete;
+
+
+    void setBytes(uint64_t byte_count) {
+        bytes = byte_count;
+    }
+};
+
+
+// Times one filter kernel call (a row band, tile or strip) by wall clock
+// only and counts no item; the image is counted once with countImage. Kernels
+// never wait, so their wall time stands in for CPU time, and the hot path
+// makes no thread CPU clock call, which is a system call on most platforms.
+class KernelTimer {
+private:
+    StatStage stage;
+    uint64_t bytes;
+    std::chrono::steady_clock::time_point wall_start;
+
+public:
+    explicit KernelTimer(StatStage timed_stage, uint64_t byte_count = 0)
+        : stage(timed_stage), bytes(byte_count), wall_start(std::chrono::steady_clock::now()) {}
+
+    ~KernelTimer() {
+        auto wall_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - wall_start).count());
+        Stats::instance().record(stage, wall_ns, wall_ns, bytes, 0);
+    }
+
+    KernelTimer(const KernelTimer&) = delete;
+    KernelTimer& operator=(const KernelTimer&) = delete;
+
+
+    // Counts one image for stage, once all of its kernel calls are done.
+    static void countImage(StatStage counted_stage) {
+        Stats::instance().record(counted_stage, 0, 0, 0, 1);
+    }
+};
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef STB_CONFIG_H
+#define STB_CONFIG_H
+
+// The one place stb is included. Decoded pixels are allocated from the
+// pooled, 64-byte aligned allocator, because PixelDeleter (filters.h) frees
+// every pixel buffer with pixelFree. The translation unit that holds stb's
+// implementation defines STB_IMAGE_IMPLEMENTATION and
+// STB_IMAGE_WRITE_IMPLEMENTATION before including this header.
+#include "pixel_allocator.h"
+
+#define STBI_MALLOC(sz) pixelMalloc(sz)
+#define STBI_REALLOC(p, newsz) pixelRealloc(p, newsz)
+#define STBI_FREE(p) pixelFree(p)
+#include "stb_image.h"
+#include "stb_image_write.h"
+
+#endif
@@ -0,0 +1,239 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <algorithm>
+
+
+// Work-stealing pool of worker threads. The thread count includes the
+// calling thread, so a pool of size 1 owns no workers and runs everything
+// inline.
+//
+// Every worker has its own deque: it pushes and pops its own tasks at the
+// back and, when that runs dry, steals the oldest task from the front of
+// another deque. Threads outside the pool submit through a shared deque.
+// A thread waiting for a parallelFor keeps running queued tasks instead of
+// blocking, so nested calls (images x bands) reuse the same workers rather
+// than starting more threads.
+class ThreadPool {
+private:
+    using Task = std::function<void()>;
+
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // Which pool and deque the current thread works for.
+    struct WorkerIdentity {
+        const ThreadPool* pool = nullptr;
+        size_t queue = 0;
+    };
+
+    // queues[0] takes tasks from threads outside the pool; queues[i + 1]
+    // belongs to workers[i].
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> queued_count;
+    std::mutex sleep_mutex;
+    std::condition_variable work_available;
+    bool stopping;
+
+
+    static WorkerIdentity& currentWorker() {
+        static thread_local WorkerIdentity identity;
+        return identity;
+    }
+
+
+    size_t ownQueue() const {
+        const WorkerIdentity& identity = currentWorker();
+        return (identity.pool == this) ? identity.queue : 0;
+    }
+
+
+    void push(Task task) {
+        TaskQueue& queue = *queues[ownQueue()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+        queued_count++;
+
+        // Taking the lock orders this push before a worker's emptiness check,
+        // so the notification cannot be lost.
+        { std::lock_guard<std::mutex> lock(sleep_mutex); }
+        work_available.notify_one();
+    }
+
+
+    // Own deque newest first, while its data is still in cache; other deques
+    // oldest first, which are the largest pieces of work left.
+    bool tryPop(size_t home, Task& task) {
+        if (queued_count.load() == 0) return false;
+
+        {
+            TaskQueue& own = *queues[home];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                queued_count--;
+                return true;
+            }
+        }
+
+        for (size_t offset = 1; offset < queues.size(); offset++) {
+            TaskQueue& victim = *queues[(home + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                queued_count--;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+
+    void workerLoop(size_t home) {
+        currentWorker() = {this, home};
+        Task task;
+
+        while (true) {
+            if (tryPop(home, task)) {
+                task();
+                task = nullptr;
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            work_available.wait(lock, [this] { return stopping || queued_count.load() > 0; });
+
+            if (stopping && queued_count.load() == 0) {
+                return;
+            }
+        }
+    }
+
+public:
+    explicit ThreadPool(unsigned int thread_count) : queued_count(0), stopping(false) {
+        thread_count = std::max(1u, thread_count);
+        for (unsigned int i = 0; i < thread_count; i++) {
+            queues.push_back(std::make_unique<TaskQueue>());
+        }
+        for (unsigned int i = 1; i < thread_count; i++) {
+            workers.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            stopping = true;
+        }
+        work_available.notify_all();
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+
+    unsigned int size() const {
+        return static_cast<unsigned int>(workers.size()) + 1;
+    }
+
+
+    // Calls fn(index) for every index in [0, count) and returns once all calls
+    // have finished. Indices are handed out dynamically, so uneven work items
+    // (large and small images) still keep every thread busy. Safe to call
+    // from inside fn: the inner call's tasks go to the calling worker's deque
+    // and idle workers steal them. If fn throws, the first exception is
+    // rethrown to the caller after all calls in flight have returned.
+    template <typename Fn>
+    void parallelFor(size_t count, Fn&& fn) {
+        if (count == 0) return;
+
+        if (workers.empty() || count == 1) {
+            for (size_t i = 0; i < count; i++) {
+                fn(i);
+            }
+            return;
+        }
+
+        std::atomic<size_t> next_index(0);
+        size_t helper_count = std::min(workers.size(), count - 1);
+        std::atomic<size_t> helpers_running(helper_count);
+
+        // The first exception thrown by fn is kept and rethrown here once every
+        // helper has stopped using this frame; indices not yet handed out are
+        // skipped.
+        std::exception_ptr first_error;
+        std::mutex error_mutex;
+
+        auto drain = [&]() {
+            for (size_t i = next_index++; i < count; i = next_index++) {
+                try {
+                    fn(i);
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if (!first_error) {
+                        first_error = std::current_exception();
+                    }
+                    next_index = count;
+                }
+            }
+        };
+
+        for (size_t i = 0; i < helper_count; i++) {
+            push([&]() {
+                drain();
+                helpers_running--;
+            });
+        }
+
+        drain();
+
+        // Help instead of blocking until the helpers still running finish.
+        // Helpers that never started find no indices left and return at once.
+        size_t home = ownQueue();
+        Task task;
+        unsigned int idle_rounds = 0;
+        while (helpers_running.load() > 0) {
+            if (tryPop(home, task)) {
+                task();
+                task = nullptr;
+                idle_rounds = 0;
+            }
+            else if (++idle_rounds < 64) {
+                std::this_thread::yield();
+            }
+            else {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+
+        if (first_error) {
+            std::rethrow_exception(first_error);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+// Records spans in Chrome Trace Event format, which chrome://tracing and
+// Perfetto open directly. Every thread appends to its own buffer without
+// locking; buffers are only read when the trace is written, which happens
+// between commands while no pipeline work is running.
+//
+// While tracing is off a span costs one relaxed atomic load.
+class TraceRecorder {
+private:
+    struct Event {
+        const char* name;
+        std::string file;
+        uint64_t pixels;
+        int64_t start_ns;
+        int64_t duration_ns;
+    };
+
+    struct ThreadBuffer {
+        size_t thread_id;
+        std::vector<Event> events;
+    };
+
+    std::atomic<bool> enabled;
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    std::string output_path;
+    std::chrono::steady_clock::time_point start_time;
+
+
+    TraceRecorder() : enabled(false) {}
+
+
+    // Created on a thread's first span and kept for the life of the process,
+    // so a worker that exits does not take its events with it.
+    ThreadBuffer& threadBuffer() {
+        static thread_local ThreadBuffer* buffer = nullptr;
+        if (!buffer) {
+            std::lock_guard<std::mutex> lock(mutex);
+            buffers.push_back(std::make_unique<ThreadBuffer>());
+            buffer = buffers.back().get();
+            buffer->thread_id = buffers.size();
+        }
+        return *buffer;
+    }
+
+
+    static std::string jsonString(const std::string& text) {
+        std::string quoted = "\"";
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                quoted += '\\';
+                quoted += c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                quoted += escaped;
+            }
+            else {
+                quoted += c;
+            }
+        }
+        return quoted + "\"";
+    }
+
+public:
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+
+    static TraceRecorder& instance() {
+        static TraceRecorder recorder;
+        return recorder;
+    }
+
+
+    bool isEnabled() const {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+
+    const std::string& getOutputPath() const {
+        return output_path;
+    }
+
+
+    // Drops anything recorded before and starts a new trace for path.
+    void start(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& buffer : buffers) {
+            buffer->events.clear();
+        }
+        output_path = path;
+        start_time = std::chrono::steady_clock::now();
+        enabled.store(true, std::memory_order_relaxed);
+    }
+
+
+    void record(const char* name, std::string file, uint64_t pixels,
+                std::chrono::steady_clock::time_point span_start, std::chrono::steady_clock::time_point span_end) {
+        auto since_start = [this](std::chrono::steady_clock::time_point time) {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(time - start_time).count();
+        };
+        int64_t start_ns = since_start(span_start);
+        threadBuffer().events.push_back({name, std::move(file), pixels, start_ns, since_start(span_end) - start_ns});
+    }
+
+
+    // Stops recording and writes every span as one "X" (complete) event,
+    // plus a name for each thread. Returns the number of spans written, or
+    // -1 if the file could not be written.
+    long long stop() {
+        enabled.store(false, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::ofstream trace(output_path);
+        if (!trace) return -1;
+
+        long long event_count = 0;
+        trace << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        bool first = true;
+
+        for (const auto& buffer : buffers) {
+            if (buffer->events.empty()) continue;
+
+            trace << (first ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":"
+                  << buffer->thread_id << ",\"args\":{\"name\":\"thread " << buffer->thread_id << "\"}}";
+            first = false;
+
+            char timing[64];
+            for (const Event& event : buffer->events) {
+                std::snprintf(timing, sizeof(timing), "\"ts\":%.3f,\"dur\":%.3f",
+                              event.start_ns / 1000.0, event.duration_ns / 1000.0);
+                trace << ",\n{\"ph\":\"X\",\"name\":\"" << event.name << "\",\"pid\":1,\"tid\":" << buffer->thread_id
+                      << "," << timing << ",\"args\":{\"file\":" << jsonString(event.file)
+                      << ",\"pixels\":" << event.pixels << "}}";
+                event_count++;
+            }
+            buffer->events.clear();
+        }
+
+        trace << "\n]}\n";
+        return trace ? event_count : -1;
+    }
+};
+
+
+// One span from construction to destruction on the calling thread. The
+// name must be a string literal; the pixel count may be filled in later,
+// e.g. once a decode knows the image size.
+class TraceSpan {
+private:
+    const char* name;
+    const std::string* file;
+    uint64_t pixels;
+    bool active;
+    std::chrono::steady_clock::time_point start_time;
+
+public:
+    TraceSpan(const char* span_name, const std::string& file_name, uint64_t pixel_count = 0)
+        : name(span_name), file(&file_name), pixels(pixel_count),
+          active(TraceRecorder::instance().isEnabled()) {
+        if (active) {
+            start_time = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~TraceSpan() {
+        if (active) {
+            TraceRecorder::instance().record(name, *file, pixels, start_time, std::chrono::steady_clock::now());
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+
+    void setPixels(uint64_t pixel_count) {
+        pixels = pixel_count;
+    }
+};
+
+#endif
@@ -0,0 +1,409 @@
+// morph_bench: measures Morph's kernels, codecs and the full pipeline on
+// synthetic images. Build alongside main.cpp, not with it (see README).
+#define _CRT_SECURE_NO_WARNINGS
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_config.h"
+
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <vector>
+#include <cstring>
+#include <random>
+#include <system_error>
+#include "filters.h"
+
+namespace fs = std::filesystem;
+
+
+struct BenchSize {
+    const char* name;
+    int width;
+    int height;
+};
+
+
+struct BenchResult {
+    std::string group;
+    std::string name;
+    std::string image;
+    size_t iterations;
+    double seconds;         // per iteration
+    double megapixels;      // per iteration
+    double megabytes;       // decoded pixel bytes per iteration
+
+    double megapixelsPerSecond() const {
+        return (seconds > 0.0) ? megapixels / seconds : 0.0;
+    }
+
+    double megabytesPerSecond() const {
+        return (seconds > 0.0) ? megabytes / seconds : 0.0;
+    }
+};
+
+
+struct BenchOptions {
+    bool quick = false;
+    double min_seconds = 0.25;
+    std::string json_path;
+    std::string only_group;
+};
+
+
+// Smooth gradients with a little noise: compressible like a photo, but not
+// so uniform that PNG and JPEG finish instantly.
+ImageData makeSyntheticImage(int width, int height, int channels, const std::string& extension) {
+    ImageData img;
+    img.width = width;
+    img.height = height;
+    img.channels = channels;
+    img.original_path = "synthetic" + extension;
+    img.filename = "synthetic" + extension;
+    img.pixels = PixelBuffer(allocatePixels(img.byteSize()));
+
+    unsigned int noise = 12345;
+    unsigned char* p = img.pixels.get();
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            for (int c = 0; c < channels; c++) {
+                noise = noise * 1103515245u + 12345u;
+                int value = (x * 255 / width) * (c + 1) / 2 + (y * 255 / height) / (c + 1) + ((noise >> 16) & 15);
+                *p++ = static_cast<unsigned char>((c == 3) ? 255 - (x & 63) : value & 255);
+            }
+        }
+    }
+    return img;
+}
+
+
+std::string describeImage(int width, int height, int channels) {
+    return std::to_string(width) + "x" + std::to_string(height) + "x" + std::to_string(channels);
+}
+
+
+// Runs fn until at least min_seconds have passed (at least once) and
+// reports the mean time per call.
+template <typename Fn>
+BenchResult measure(const std::string& group, const std::string& name, const std::string& image,
+                    double megapixels, double megabytes, double min_seconds, Fn&& fn) {
+    auto start_time = std::chrono::steady_clock::now();
+    size_t iterations = 0;
+    double elapsed_seconds = 0.0;
+
+    do {
+        fn();
+        iterations++;
+        elapsed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    } while (elapsed_seconds < min_seconds);
+
+    BenchResult result = {group, name, image, iterations, elapsed_seconds / iterations, megapixels, megabytes};
+    std::cout << "  " << result.group << " " << result.name << " " << result.image << ": "
+              << result.megapixelsPerSecond() << " MP/s, " << result.megabytesPerSecond() << " MB/s ("
+              << result.iterations << " run(s))" << std::endl;
+    return result;
+}
+
+
+bool wantGroup(const BenchOptions& options, const std::string& group) {
+    return options.only_group.empty() || options.only_group == group;
+}
+
+
+// Every filter op through the dispatched path on one thread, and grayscale
+// and the tone lookup once per SIMD level this CPU supports, so a
+// regression in one kernel is not hidden by dispatch picking another.
+void benchFilters(const BenchOptions& options, const std::vector<BenchSize>& sizes,
+                  std::vector<BenchResult>& results) {
+    std::vector<std::pair<std::string, FilterOp>> filters = {
+        {"grayscale", makeGrayscaleOp(60.0)},
+        {"levels", makeLevelsOp(16, 235, 1.2)},
+        {"blur 2", makeBlurOp(2.0, 100.0)},
+        {"blur 8", makeBlurOp(8.0, 100.0)},
+        {"blur 200", makeBlurOp(200.0, 100.0)},
+        {"box blur 20", makeBoxBlurOp(20, 100.0)},
+        {"sharpen 1", makeSharpenOp(1.0, 100.0)},
+    };
+
+    std::vector<SimdLevel> levels = {SimdLevel::Scalar};
+    for (SimdLevel level : {SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512}) {
+        if (static_cast<int>(level) <= static_cast<int>(simdLevel())) {
+            levels.push_back(level);
+        }
+    }
+
+    for (const BenchSize& size : sizes) {
+        for (int channels : {3, 4}) {
+            ImageData img = makeSyntheticImage(size.width, size.height, channels, ".png");
+            size_t pixel_count = static_cast<size_t>(img.width) * img.height;
+            double megapixels = pixel_count / 1e6;
+            double megabytes = img.byteSize() / (1024.0 * 1024.0);
+            std::string image = describeImage(img.width, img.height, channels);
+
+            if (wantGroup(options, "filter")) {
+                for (const auto& filter : filters) {
+                    const FilterOp& op = filter.second;
+                    results.push_back(measure("filter", filter.first, image, megapixels, megabytes,
+                                              options.min_seconds, [&]() {
+                        if (op.isPointOp()) {
+                            applyFilterOp(op, img.pixels.get(), pixel_count, img.channels);
+                        }
+                        else {
+                            applySpatialOp(op, img, nullptr);
+                        }
+                    }));
+                }
+            }
+
+            if (wantGroup(options, "kernel")) {
+                int blend_weight = makeGrayscaleOp(60.0).amount;
+                for (SimdLevel level : levels) {
+                    std::string name = std::string("grayscale/") + simdLevelName(level);
+                    results.push_back(measure("kernel", name, image, megapixels, megabytes, options.min_seconds,
+                        [&]() { grayscalePixels(img.pixels.get(), pixel_count, img.channels, blend_weight, level); }));
+                }
+
+                // Inverting twice restores the image, so repeated runs stay comparable.
+                PointLut invert = *makeInvertOp(100.0).lut;
+                for (SimdLevel level : levels) {
+                    std::string name = std::string("lookup/") + simdLevelName(level);
+                    results.push_back(measure("kernel", name, image, megapixels, megabytes, options.min_seconds,
+                        [&]() { lookupPixels(img.pixels.get(), pixel_count, img.channels, invert, level); }));
+                }
+            }
+        }
+    }
+}
+
+
+// Encodes each format once per size and channel count, then decodes the
+// file it wrote: the per-file work of export and loadSingleImage.
+void benchCodecs(const BenchOptions& options, const std::vector<BenchSize>& sizes, const fs::path& work_dir,
+                 std::vector<BenchResult>& results) {
+    for (const char* extension : {".png", ".jpg", ".bmp"}) {
+        std::string format = extension + 1;
+
+        for (const BenchSize& size : sizes) {
+            for (int channels : {1, 3, 4}) {
+                ImageData img = makeSyntheticImage(size.width, size.height, channels, extension);
+                double megapixels = static_cast<double>(img.width) * img.height / 1e6;
+                double megabytes = img.byteSize() / (1024.0 * 1024.0);
+                std::string image = describeImage(img.width, img.height, channels);
+                std::string file_path = (work_dir / ("codec" + std::string(extension))).string();
+
+                if (wantGroup(options, "encode")) {
+                    results.push_back(measure("encode", format, image, megapixels, megabytes, options.min_seconds,
+                        [&]() { Pipeline::encodeFile(img, file_path); }));
+                }
+                else {
+                    Pipeline::encodeFile(img, file_path);
+                }
+
+                if (wantGroup(options, "decode")) {
+                    results.push_back(measure("decode", format, image, megapixels, megabytes, options.min_seconds,
+                        [&]() {
+                            ImageData decoded;
+                            Pipeline::decodeFile(file_path, decoded);
+                        }));
+                }
+            }
+        }
+    }
+}
+
+
+// The whole -i, @i grayscale, -o flow on a folder of mixed images, in a
+// fresh Pipeline each run so every run loads from disk.
+void benchPipeline(const BenchOptions& options, const fs::path& work_dir, std::vector<BenchResult>& results) {
+    fs::path input_dir = work_dir / "flow_input";
+    fs::path output_dir = work_dir / "flow_output";
+    fs::create_directories(input_dir);
+
+    // Pipeline's constructor reports every Morph/ folder it has to create;
+    // creating them up front keeps those lines out of the results.
+    fs::create_directories("Morph/input");
+    fs::create_directories("Morph/output");
+
+    int image_count = options.quick ? 8 : 32;
+    const char* extensions[] = {".png", ".jpg", ".bmp"};
+    double megapixels = 0.0;
+    double megabytes = 0.0;
+
+    for (int i = 0; i < image_count; i++) {
+        const char* extension = extensions[i % 3];
+        int channels = (i % 4 == 0) ? 4 : 3;
+        ImageData img = makeSyntheticImage(1280, 720, channels, extension);
+        Pipeline::encodeFile(img, (input_dir / ("frame" + std::to_string(i) + extension)).string());
+        megapixels += static_cast<double>(img.width) * img.height / 1e6;
+        megabytes += img.byteSize() / (1024.0 * 1024.0);
+    }
+
+    std::string image = std::to_string(image_count) + " x 1280x720";
+    results.push_back(measure("pipeline", "load-grayscale-export", image, megapixels, megabytes,
+                              options.min_seconds, [&]() {
+        Pipeline pipeline;
+        pipeline.setReportMode(ReportMode::Quiet);
+        pipeline.addInput(input_dir.string());
+        pipeline.applyGrayscale("", 60.0);
+        pipeline.exportOutput(output_dir.string(), true);
+    }));
+}
+
+
+std::string jsonEscape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+
+// One result per line with stable key order, so two runs diff cleanly.
+bool writeJson(const std::string& json_path, const std::vector<BenchResult>& results, unsigned int threads) {
+    std::ofstream json(json_path);
+    if (!json) {
+        std::cerr << "Cannot write " << json_path << std::endl;
+        return false;
+    }
+
+    json << "{\n";
+    json << "  \"simd\": \"" << simdLevelName(simdLevel()) << "\",\n";
+    json << "  \"threads\": " << threads << ",\n";
+    json << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& result = results[i];
+        json << "    {\"group\": \"" << jsonEscape(result.group) << "\", \"name\": \"" << jsonEscape(result.name)
+             << "\", \"image\": \"" << jsonEscape(result.image) << "\", \"iterations\": " << result.iterations
+             << ", \"seconds\": " << result.seconds << ", \"mp_per_s\": " << result.megapixelsPerSecond()
+             << ", \"mb_per_s\": " << result.megabytesPerSecond() << "}"
+             << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    json << "  ]\n";
+    json << "}\n";
+    return static_cast<bool>(json);
+}
+
+
+void displayBenchUsage() {
+    std::cout << "Usage: morph_bench [--quick] [--min-time <s>] [--only <group>] [--json <file>]" << std::endl;
+    std::cout << "  --quick           One medium image size and a smaller pipeline run" << std::endl;
+    std::cout << "  --min-time <s>    Minimum time per measurement (default 0.25)" << std::endl;
+    std::cout << "  --only <group>    Run one group: filter, kernel, encode, decode or pipeline" << std::endl;
+    std::cout << "  --json <file>     Also write results as JSON" << std::endl;
+}
+
+
+bool parseBenchArguments(int argc, char* argv[], BenchOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+
+        if (argument == "--quick") {
+            options.quick = true;
+        }
+        else if ((argument == "--min-time" || argument == "--only" || argument == "--json") && i + 1 < argc) {
+            std::string value = argv[++i];
+            if (argument == "--only") {
+                const char* groups[] = {"filter", "kernel", "encode", "decode", "pipeline"};
+                if (std::find(std::begin(groups), std::end(groups), value) == std::end(groups)) {
+                    std::cerr << "Unknown group: " << value << std::endl;
+                    return false;
+                }
+                options.only_group = value;
+            }
+            else if (argument == "--json") {
+                options.json_path = value;
+            }
+            else {
+                try {
+                    options.min_seconds = std::stod(value);
+                }
+                catch (const std::exception& e) {
+                    std::cerr << "Invalid time: " << value << std::endl;
+                    return false;
+                }
+            }
+        }
+        else {
+            std::cerr << "Unexpected argument: " << argument << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// A new, uniquely named folder under the system temp directory, so
+// concurrent runs never share or delete each other's files. Empty on
+// failure.
+fs::path createWorkDirectory() {
+    std::random_device random;
+    fs::path temp_dir = fs::temp_directory_path();
+
+    for (int attempt = 0; attempt < 100; attempt++) {
+        fs::path candidate = temp_dir / ("morph_bench_" + std::to_string(random()));
+        std::error_code error;
+        if (fs::create_directory(candidate, error)) {
+            return candidate;
+        }
+    }
+    return fs::path();
+}
+
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    if (!parseBenchArguments(argc, argv, options)) {
+        displayBenchUsage();
+        return 2;
+    }
+
+    std::vector<BenchSize> sizes = {{"small", 640, 480}, {"medium", 1920, 1080}, {"large", 4096, 3072}};
+    if (options.quick) {
+        sizes = {{"medium", 1920, 1080}};
+    }
+
+    // The pipeline creates its Morph/ folders in the working directory, so
+    // everything runs inside a scratch folder of its own that is removed
+    // afterwards.
+    fs::path original_dir = fs::current_path();
+    fs::path work_dir = createWorkDirectory();
+    if (work_dir.empty()) {
+        std::cerr << "Could not create a scratch folder in " << fs::temp_directory_path().string() << std::endl;
+        return 1;
+    }
+    fs::current_path(work_dir);
+
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << "morph_bench: " << simdLevelName(simdLevel()) << ", " << threads << " thread(s)" << std::endl;
+
+    std::vector<BenchResult> results;
+    if (wantGroup(options, "filter") || wantGroup(options, "kernel")) {
+        std::cout << "Filters:" << std::endl;
+        benchFilters(options, sizes, results);
+    }
+    if (wantGroup(options, "encode") || wantGroup(options, "decode")) {
+        std::cout << "Codecs:" << std::endl;
+        benchCodecs(options, sizes, work_dir, results);
+    }
+    if (wantGroup(options, "pipeline")) {
+        std::cout << "Pipeline:" << std::endl;
+        benchPipeline(options, work_dir, results);
+    }
+
+    fs::current_path(original_dir);
+    fs::remove_all(work_dir);
+
+    if (!options.json_path.empty()) {
+        if (!writeJson(options.json_path, results, threads)) {
+            return 1;
+        }
+        std::cout << "Wrote " << results.size() << " result(s) to " << options.json_path << std::endl;
+    }
+    return 0;
+}
@@ -1,12 +1,13 @@
 #define _CRT_SECURE_NO_WARNINGS
 #define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
+#include "stb_config.h"
 
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <fstream>
+#include <chrono>
 #include <algorithm>
 #include <filesystem>
 #include <vector>
@@ -50,76 +51,305 @@ void displayHelp() {
     std::cout << "  @i                      List all images in input" << std::endl;
     std::cout << "  @i grayscale <percent>  Apply grayscale filter" << std::endl;
     std::cout << "  @i grayscale <percent> <filename>  Apply grayscale to specific image" << std::endl;
+    std::cout << "  @i blur <radius> [percent] [filename]     Gaussian blur" << std::endl;
+    std::cout << "  @i boxblur <radius> [percent] [filename]  Box blur (square average)" << std::endl;
+    std::cout << "  @i sharpen <amount> [percent] [filename]  Unsharp mask (amount 1 = +100% detail)" << std::endl;
+    std::cout << "  @i brightness <amount> [filename]         Add -100..100% of full scale" << std::endl;
+    std::cout << "  @i contrast <amount> [filename]           -100 (flat gray) .. 100 (threshold)" << std::endl;
+    std::cout << "  @i gamma <gamma> [filename]               Gamma curve (0.1..10, > 1 brightens)" << std::endl;
+    std::cout << "  @i levels <black> <white> [gamma] [filename]  Stretch black..white to full range" << std::endl;
+    std::cout << "  @i invert [percent] [filename]            Negative image" << std::endl;
     std::cout << "  preview                 Save images to Morph/output" << std::endl;
     std::cout << "  preview <filename>      Save specific image to Morph/output" << std::endl;
     std::cout << "  -o @\"path\"              Export images and clear" << std::endl;
     std::cout << "  -o keep @\"path\"         Export images but keep in input" << std::endl;
+    std::cout << "  set threads <n>         Set worker thread count (0 = all cores)" << std::endl;
+    std::cout << "  set defer on/off        Queue filters and run them fused at preview/export" << std::endl;
+    std::cout << "  set lazy on/off         Read headers on -i, decode pixels on first use" << std::endl;
+    std::cout << "  set memory <MB>         Cap resident pixels, evicting LRU images (0 = no limit)" << std::endl;
+    std::cout << "  set stages <d> <f> <e>  Decode/filter/encode threads for --stream (0 = auto)" << std::endl;
+    std::cout << "  set hugepages on/off    Back large frames with transparent huge pages" << std::endl;
+    std::cout << "  set report <mode>       Output: normal, quiet, summary or progress (JSON lines)" << std::endl;
+    std::cout << "  set border <mode>       Blur/sharpen edges: clamp, mirror or wrap" << std::endl;
+    std::cout << "  set trace @file / off   Record a Chrome trace of decode, filter and encode spans" << std::endl;
+    std::cout << "  stats                   Show time, bytes and items per stage" << std::endl;
+    std::cout << "  stats reset             Start counting from zero" << std::endl;
     std::cout << "  help                    Show this help message" << std::endl;
     std::cout << "  exit                    Exit program\n" << std::endl;
 }
 
 
-void handleInputCommand(Pipeline& pipeline, const std::vector<std::string>& tokens) {
+bool handleInputCommand(Pipeline& pipeline, const std::vector<std::string>& tokens) {
     if (tokens.size() < 2) {
         std::cerr << "Use -i @\"path\" to load images" << std::endl;
-        return;
+        return false;
     }
 
     std::string path = tokens[1];
     if (path[0] == '@') {
-        pipeline.addInput(path.substr(1));
+        return pipeline.addInput(path.substr(1));
     }
-    else {
-        std::cerr << "Use -i @\"path\" to load images" << std::endl;
+
+    std::cerr << "Use -i @\"path\" to load images" << std::endl;
+    return false;
+}
+
+
+// Parses "60" or "60%" into intensity.
+bool parsePercent(std::string percent_str, double& intensity) {
+    size_t percent_pos = percent_str.find('%');
+    if (percent_pos != std::string::npos) {
+        percent_str.erase(percent_str.begin() + percent_pos);
+    }
+
+    try {
+        intensity = std::stod(percent_str);
     }
+    catch (const std::exception& e) {
+        std::cerr << "Invalid percentage value: " << percent_str << std::endl;
+        return false;
+    }
+    return true;
 }
 
 
-void handleFilterCommand(Pipeline& pipeline, const std::vector<std::string>& tokens) {
-    if (tokens.size() == 1) {
-        pipeline.listInput();
-        return;
+// True for "5", "2.5" or "60%", so an optional percentage can be told apart
+// from a filename. "nan" and "inf" are not numbers here.
+bool isNumber(const std::string& token) {
+    size_t parsed_length = 0;
+    try {
+        if (!std::isfinite(std::stod(token, &parsed_length))) {
+            return false;
+        }
+    }
+    catch (const std::exception& e) {
+        return false;
     }
+    return parsed_length == token.size() || (parsed_length + 1 == token.size() && token.back() == '%');
+}
+
+
+// True for "nan", "inf" and the like, which isNumber turns away but which
+// should not be read as a filename either.
+bool isNonFiniteNumber(const std::string& token) {
+    size_t parsed_length = 0;
+    try {
+        return !std::isfinite(std::stod(token, &parsed_length)) && parsed_length == token.size();
+    }
+    catch (const std::exception& e) {
+        return false;
+    }
+}
 
+
+const double MAX_BLUR_RADIUS = 1000.0;
+const double MAX_SHARPEN_AMOUNT = 10.0;
+const double MIN_GAMMA = 0.1;
+const double MAX_GAMMA = 10.0;
+
+
+// Tone adjustments: leading numbers, then an optional filename.
+bool parseAdjustOp(const std::string& filter_name, const std::vector<std::string>& tokens, FilterOp& op,
+                   std::string& target_file, std::string& label) {
+    const char* usage = (filter_name == "brightness") ? "Use @i brightness <-100..100> [filename]"
+                      : (filter_name == "contrast") ? "Use @i contrast <-100..100> [filename]"
+                      : (filter_name == "gamma") ? "Use @i gamma <0.1..10> [filename]"
+                      : (filter_name == "levels") ? "Use @i levels <black> <white> [gamma] [filename]"
+                                                  : "Use @i invert [percent] [filename]";
+
+    std::vector<double> values;
+    size_t next = 2;
+    while (next < tokens.size() && isNumber(tokens[next])) {
+        if (tokens[next].back() == '%' && filter_name != "invert") {
+            std::cerr << usage << std::endl;
+            return false;
+        }
+        double value = 0.0;
+        parsePercent(tokens[next++], value);
+        values.push_back(value);
+    }
+    if (next < tokens.size() && !isNonFiniteNumber(tokens[next])) {
+        target_file = tokens[next++];
+    }
+
+    size_t min_values = (filter_name == "invert") ? 0 : (filter_name == "levels") ? 2 : 1;
+    size_t max_values = (filter_name == "levels") ? 3 : 1;
+    if (next < tokens.size() || values.size() < min_values || values.size() > max_values) {
+        std::cerr << usage << std::endl;
+        return false;
+    }
+
+    std::ostringstream text;
+    text << filter_name;
+
+    if (filter_name == "brightness" || filter_name == "contrast") {
+        if (!(values[0] >= -100.0 && values[0] <= 100.0)) {
+            std::cerr << "Amount must be between -100 and 100" << std::endl;
+            return false;
+        }
+        op = (filter_name == "brightness") ? makeBrightnessOp(values[0]) : makeContrastOp(values[0]);
+        text << " " << values[0];
+    }
+    else if (filter_name == "gamma") {
+        if (!(values[0] >= MIN_GAMMA && values[0] <= MAX_GAMMA)) {
+            std::cerr << "Gamma must be between " << MIN_GAMMA << " and " << MAX_GAMMA << std::endl;
+            return false;
+        }
+        op = makeGammaOp(values[0]);
+        text << " " << values[0];
+    }
+    else if (filter_name == "levels") {
+        double black = std::round(values[0]);
+        double white = std::round(values[1]);
+        double gamma = (values.size() == 3) ? values[2] : 1.0;
+        if (!(black >= 0.0 && black < white && white <= 255.0)) {
+            std::cerr << "Levels need 0 <= black < white <= 255" << std::endl;
+            return false;
+        }
+        if (!(gamma >= MIN_GAMMA && gamma <= MAX_GAMMA)) {
+            std::cerr << "Gamma must be between " << MIN_GAMMA << " and " << MAX_GAMMA << std::endl;
+            return false;
+        }
+        op = makeLevelsOp(static_cast<int>(black), static_cast<int>(white), gamma);
+        text << " " << black << "-" << white << " (gamma " << gamma << ")";
+    }
+    else {
+        double percent = values.empty() ? 100.0 : std::max(0.0, std::min(100.0, values[0]));
+        op = makeInvertOp(percent);
+        text << " (" << percent << "%)";
+    }
+
+    label = text.str();
+    return true;
+}
+
+
+// Parses the arguments of "@i <filter> ..." into an op, the target file
+// ("" for every image) and a label for messages:
+//   @i grayscale [percent] [file]
+//   @i blur <radius> [percent] [file]
+//   @i boxblur <radius> [percent] [file]
+//   @i sharpen <amount> [percent] [file]
+//   @i brightness|contrast <amount> [file]
+//   @i gamma <gamma> [file]
+//   @i levels <black> <white> [gamma] [file]
+//   @i invert [percent] [file]
+bool parseFilterOp(const std::vector<std::string>& tokens, FilterOp& op, std::string& target_file,
+                   std::string& label) {
     std::string filter_name = tokens[1];
     std::transform(filter_name.begin(), filter_name.end(), filter_name.begin(), ::tolower);
 
     if (filter_name == "grayscale") {
         std::string percent_str = (tokens.size() >= 3) ? tokens[2] : "100";
-        std::string target_file = (tokens.size() >= 4) ? tokens[3] : "";
+        target_file = (tokens.size() >= 4) ? tokens[3] : "";
 
-        size_t percent_pos = percent_str.find('%');
-        if (percent_pos != std::string::npos) {
-            percent_str.erase(percent_str.begin() + percent_pos);
+        double intensity = 100.0;
+        if (!parsePercent(percent_str, intensity)) {
+            return false;
         }
 
-        double intensity = 100.0;
-        try {
-            intensity = std::stod(percent_str);
+        intensity = std::max(0.0, std::min(100.0, intensity));
+        op = makeGrayscaleOp(intensity);
+        std::ostringstream text;
+        text << "grayscale (" << intensity << "%)";
+        label = text.str();
+        return true;
+    }
+
+    if (filter_name == "blur" || filter_name == "boxblur" || filter_name == "sharpen") {
+        bool sharpen = (filter_name == "sharpen");
+        bool box = (filter_name == "boxblur");
+        const char* usage = sharpen ? "Use @i sharpen <amount> [percent] [filename]"
+                          : box ? "Use @i boxblur <radius> [percent] [filename]"
+                                : "Use @i blur <radius> [percent] [filename]";
+        if (tokens.size() < 3 || tokens.size() > 5 || !isNumber(tokens[2]) || tokens[2].back() == '%') {
+            std::cerr << usage << std::endl;
+            return false;
+        }
+
+        double value = std::stod(tokens[2]);
+        if (!std::isfinite(value)) {
+            std::cerr << usage << std::endl;
+            return false;
+        }
+        if (box) {
+            value = std::round(value);
+        }
+        if (!sharpen && !(value > 0.0 && value <= MAX_BLUR_RADIUS)) {
+            std::cerr << "Blur radius must be above 0 and at most " << MAX_BLUR_RADIUS << std::endl;
+            return false;
+        }
+        if (sharpen && !(value >= 0.0 && value <= MAX_SHARPEN_AMOUNT)) {
+            std::cerr << "Sharpen amount must be between 0 and " << MAX_SHARPEN_AMOUNT << std::endl;
+            return false;
+        }
+
+        double percent = 100.0;
+        size_t next = 3;
+        if (next < tokens.size() && isNumber(tokens[next])) {
+            parsePercent(tokens[next++], percent);
         }
-        catch (const std::invalid_argument& e) {
-            std::cerr << "Invalid percentage value: " << percent_str << std::endl;
-            return;
+        if (next < tokens.size()) {
+            target_file = tokens[next++];
+        }
+        if (next < tokens.size()) {
+            std::cerr << usage << std::endl;
+            return false;
         }
 
-        pipeline.applyGrayscale(target_file, intensity);
+        percent = std::max(0.0, std::min(100.0, percent));
+        if (sharpen) {
+            op = makeSharpenOp(value, percent);
+        }
+        else if (box) {
+            op = makeBoxBlurOp(static_cast<int>(value), percent);
+        }
+        else {
+            op = makeBlurOp(value, percent);
+        }
+        std::ostringstream text;
+        text << filter_name << " " << value << " (" << percent << "%)";
+        label = text.str();
+        return true;
     }
-    else {
-        std::cerr << "Unknown filter: " << filter_name << std::endl;
+
+    if (filter_name == "brightness" || filter_name == "contrast" || filter_name == "gamma" ||
+        filter_name == "levels" || filter_name == "invert") {
+        return parseAdjustOp(filter_name, tokens, op, target_file, label);
+    }
+
+    std::cerr << "Unknown filter: " << filter_name << std::endl;
+    return false;
+}
+
+
+bool handleFilterCommand(Pipeline& pipeline, const std::vector<std::string>& tokens) {
+    if (tokens.size() == 1) {
+        pipeline.listInput();
+        return true;
     }
+
+    FilterOp op = makeGrayscaleOp(100.0);
+    std::string target_file;
+    std::string label;
+    if (!parseFilterOp(tokens, op, target_file, label)) {
+        return false;
+    }
+
+    return pipeline.applyFilter(op, label, target_file);
 }
 
 
-void handlePreviewCommand(Pipeline& pipeline, const std::vector<std::string>& tokens) {
+bool handlePreviewCommand(Pipeline& pipeline, const std::vector<std::string>& tokens) {
     std::string target_file = (tokens.size() >= 2) ? tokens[1] : "";
-    pipeline.savePreview(target_file);
+    return pipeline.savePreview(target_file);
 }
 
 
-void handleOutputCommand(Pipeline& pipeline, const std::vector<std::string>& tokens) {
+bool handleOutputCommand(Pipeline& pipeline, const std::vector<std::string>& tokens) {
     if (tokens.size() < 2) {
         std::cerr << "Use -o @\"path\" [keep/clear] [filename] to export" << std::endl;
-        return;
+        return false;
     }
 
     std::string output_path;
@@ -147,14 +377,588 @@ void handleOutputCommand(Pipeline& pipeline, const std::vector<std::string>& tok
 
     if (output_path.empty()) {
         std::cerr << "Use -o @\"path\" [keep/clear] [filename] to export" << std::endl;
-        return;
+        return false;
     }
 
-    pipeline.exportOutput(output_path, clear_after_export, target_file);
+    return pipeline.exportOutput(output_path, clear_after_export, target_file);
 }
 
 
-int main() {
+// Accepts on/off (also true/false, 1/0) for boolean settings.
+bool parseSwitch(const std::string& value, bool& enabled) {
+    std::string value_lower = value;
+    std::transform(value_lower.begin(), value_lower.end(), value_lower.begin(), ::tolower);
+
+    if (value_lower == "on" || value_lower == "true" || value_lower == "1") {
+        enabled = true;
+        return true;
+    }
+    if (value_lower == "off" || value_lower == "false" || value_lower == "0") {
+        enabled = false;
+        return true;
+    }
+
+    std::cerr << "Expected on or off, got: " << value << std::endl;
+    return false;
+}
+
+
+// Setting confirmations are narrative output, so only normal mode prints them.
+void confirmSetting(const Pipeline& pipeline, const std::string& text) {
+    if (pipeline.getReportMode() == ReportMode::Normal) {
+        std::cout << text << std::endl;
+    }
+}
+
+
+bool parseReportMode(const std::string& value, ReportMode& mode) {
+    std::string name = value;
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+    if (name == "normal") mode = ReportMode::Normal;
+    else if (name == "quiet") mode = ReportMode::Quiet;
+    else if (name == "summary") mode = ReportMode::Summary;
+    else if (name == "progress") mode = ReportMode::Progress;
+    else {
+        std::cerr << "Expected normal, quiet, summary or progress, got: " << value << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+bool handleSetCommand(Pipeline& pipeline, const std::vector<std::string>& tokens) {
+    if (tokens.size() < 3) {
+        std::cerr << "Use set threads <n>, set defer on/off, set lazy on/off, set memory <MB>, "
+                  << "set stages <decode> <filter> <encode>, set hugepages on/off, "
+                  << "set report normal/quiet/summary/progress, set border clamp/mirror/wrap "
+                  << "or set trace @file/off" << std::endl;
+        return false;
+    }
+
+    std::string option = tokens[1];
+    std::transform(option.begin(), option.end(), option.begin(), ::tolower);
+
+    if (option == "threads") {
+        int thread_count = 0;
+        try {
+            thread_count = std::stoi(tokens[2]);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Invalid thread count: " << tokens[2] << std::endl;
+            return false;
+        }
+
+        if (thread_count < 0) {
+            std::cerr << "Invalid thread count: " << tokens[2] << std::endl;
+            return false;
+        }
+
+        pipeline.setThreadCount(static_cast<unsigned int>(thread_count));
+        confirmSetting(pipeline, "Using " + std::to_string(pipeline.getThreadCount()) + " thread(s)");
+        return true;
+    }
+    else if (option == "defer") {
+        bool deferred = false;
+        if (!parseSwitch(tokens[2], deferred)) {
+            return false;
+        }
+
+        pipeline.setDeferredFilters(deferred);
+        confirmSetting(pipeline, std::string("Deferred filters ") + (deferred ? "on" : "off"));
+        return true;
+    }
+    else if (option == "lazy") {
+        bool lazy = false;
+        if (!parseSwitch(tokens[2], lazy)) {
+            return false;
+        }
+
+        pipeline.setLazyLoading(lazy);
+        confirmSetting(pipeline, std::string("Lazy loading ") + (lazy ? "on" : "off"));
+        return true;
+    }
+    else if (option == "memory") {
+        double limit_mb = 0;
+        try {
+            limit_mb = std::stod(tokens[2]);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Invalid memory limit: " << tokens[2] << std::endl;
+            return false;
+        }
+
+        if (!std::isfinite(limit_mb) || limit_mb < 0) {
+            std::cerr << "Invalid memory limit: " << tokens[2] << std::endl;
+            return false;
+        }
+
+        pipeline.setMemoryLimit(static_cast<size_t>(limit_mb * 1024.0 * 1024.0));
+        std::ostringstream confirmation;
+        if (limit_mb == 0) {
+            confirmation << "Memory limit off";
+        }
+        else {
+            confirmation << "Memory limit " << limit_mb << " MB";
+        }
+        confirmSetting(pipeline, confirmation.str());
+        return true;
+    }
+    else if (option == "hugepages") {
+        bool huge_pages = false;
+        if (!parseSwitch(tokens[2], huge_pages)) {
+            return false;
+        }
+
+        pipeline.setHugePages(huge_pages);
+        confirmSetting(pipeline, std::string("Huge pages ") + (huge_pages ? "on" : "off"));
+        return true;
+    }
+    else if (option == "stages") {
+        if (tokens.size() != 5) {
+            std::cerr << "Use set stages <decode> <filter> <encode>" << std::endl;
+            return false;
+        }
+
+        int stage_counts[3];
+        for (int i = 0; i < 3; i++) {
+            try {
+                stage_counts[i] = std::stoi(tokens[2 + i]);
+            }
+            catch (const std::exception& e) {
+                stage_counts[i] = -1;
+            }
+
+            if (stage_counts[i] < 0) {
+                std::cerr << "Invalid thread count: " << tokens[2 + i] << std::endl;
+                return false;
+            }
+        }
+
+        pipeline.setStageThreads(stage_counts[0], stage_counts[1], stage_counts[2]);
+
+        unsigned int decode_count, filter_count, encode_count;
+        pipeline.getStageThreads(decode_count, filter_count, encode_count);
+        confirmSetting(pipeline, "Streaming stages: decode " + std::to_string(decode_count) + ", filter " +
+                                 std::to_string(filter_count) + ", encode " + std::to_string(encode_count) +
+                                 " thread(s)");
+        return true;
+    }
+    else if (option == "report") {
+        ReportMode mode = ReportMode::Normal;
+        if (!parseReportMode(tokens[2], mode)) {
+            return false;
+        }
+
+        pipeline.setReportMode(mode);
+        confirmSetting(pipeline, "Report mode normal");
+        return true;
+    }
+    else if (option == "border") {
+        std::string mode_name = tokens[2];
+        std::transform(mode_name.begin(), mode_name.end(), mode_name.begin(), ::tolower);
+
+        BorderMode mode = BorderMode::Clamp;
+        if (mode_name == "mirror") mode = BorderMode::Mirror;
+        else if (mode_name == "wrap") mode = BorderMode::Wrap;
+        else if (mode_name != "clamp") {
+            std::cerr << "Expected clamp, mirror or wrap, got: " << tokens[2] << std::endl;
+            return false;
+        }
+
+        pipeline.setBorderMode(mode);
+        confirmSetting(pipeline, std::string("Border mode ") + borderModeName(mode));
+        return true;
+    }
+    else if (option == "trace") {
+        std::string value_lower = tokens[2];
+        std::transform(value_lower.begin(), value_lower.end(), value_lower.begin(), ::tolower);
+
+        if (value_lower == "off") {
+            return pipeline.stopTrace();
+        }
+
+        std::string trace_path = (tokens[2][0] == '@') ? tokens[2].substr(1) : tokens[2];
+        if (trace_path.empty() || !pipeline.startTrace(trace_path)) {
+            return false;
+        }
+        confirmSetting(pipeline, "Tracing to " + trace_path);
+        return true;
+    }
+
+    std::cerr << "Unknown setting: " << option << std::endl;
+    return false;
+}
+
+
+bool handleStatsCommand(Pipeline& pipeline, const std::vector<std::string>& tokens) {
+    if (tokens.size() == 1) {
+        pipeline.showStats();
+        return true;
+    }
+
+    std::string option = tokens[1];
+    std::transform(option.begin(), option.end(), option.begin(), ::tolower);
+    if (tokens.size() == 2 && option == "reset") {
+        pipeline.resetStats();
+        confirmSetting(pipeline, "Stats reset");
+        return true;
+    }
+
+    std::cerr << "Use stats or stats reset" << std::endl;
+    return false;
+}
+
+
+bool isCommandName(const std::string& token) {
+    std::string command = token;
+    std::transform(command.begin(), command.end(), command.begin(), ::tolower);
+
+    return command == "-i" || command == "-o" || command == "@i" || command == "preview" ||
+           command == "list" || command == "set" || command == "stats" || command == "help" ||
+           command == "exit" || command == "quit";
+}
+
+
+// Runs one parsed command. Returns false if it failed; exit/quit are handled
+// by the caller.
+bool executeCommand(Pipeline& pipeline, const std::vector<std::string>& tokens) {
+    std::string command = tokens[0];
+    std::transform(command.begin(), command.end(), command.begin(), ::tolower);
+
+    if (command == "help") {
+        displayHelp();
+        return true;
+    }
+    else if (command == "-i") {
+        return handleInputCommand(pipeline, tokens);
+    }
+    else if (command == "@i") {
+        return handleFilterCommand(pipeline, tokens);
+    }
+    else if (command == "preview") {
+        return handlePreviewCommand(pipeline, tokens);
+    }
+    else if (command == "-o") {
+        return handleOutputCommand(pipeline, tokens);
+    }
+    else if (command == "set") {
+        return handleSetCommand(pipeline, tokens);
+    }
+    else if (command == "list") {
+        pipeline.listInput();
+        return true;
+    }
+    else if (command == "stats") {
+        return handleStatsCommand(pipeline, tokens);
+    }
+
+    std::cerr << "Unknown command. Type 'help' for available commands." << std::endl;
+    return false;
+}
+
+
+void displayExitSummary(Pipeline& pipeline) {
+    pipeline.stopTrace();
+
+    if (!Stats::instance().empty()) {
+        pipeline.showStats();
+    }
+
+    size_t memory_bytes = pipeline.getMemoryUsage();
+    if (memory_bytes > 0 && pipeline.getReportMode() == ReportMode::Normal) {
+        double memory_mb = memory_bytes / (1024.0 * 1024.0);
+        std::cout << "\nClearing " << memory_mb << " MB from input..." << std::endl;
+    }
+}
+
+
+void displayUsage() {
+    std::cout << "Usage:" << std::endl;
+    std::cout << "  morph                           Interactive mode" << std::endl;
+    std::cout << "  morph <command> [args] ...      Run commands from the command line" << std::endl;
+    std::cout << "  morph --script <file>           Run commands from a script file" << std::endl;
+    std::cout << "  morph --stream <commands>       Stream each file through load, filters and export" << std::endl;
+    std::cout << "  morph --quiet|--summary|--progress <commands>" << std::endl;
+    std::cout << "                                  Same as starting with set report <mode>" << std::endl;
+    std::cout << "  morph --trace <file> <commands> Same as starting with set trace @<file>" << std::endl;
+    std::cout << "\nExample:" << std::endl;
+    std::cout << "  morph -i @photos \"@i grayscale 50%\" -o @out" << std::endl;
+}
+
+
+// Script files hold one command per line, exactly as typed at the prompt.
+// Blank lines and lines starting with '#' are skipped.
+bool loadScriptFile(const std::string& script_path, std::vector<std::vector<std::string>>& commands) {
+    std::ifstream script(script_path);
+    if (!script) {
+        std::cerr << "Cannot open script: " << script_path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int line_number = 0;
+
+    while (std::getline(script, line)) {
+        line_number++;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+
+        size_t first = line.find_first_not_of(" \t");
+        if (first == std::string::npos || line[first] == '#') continue;
+
+        std::vector<std::string> tokens = parseCommand(line.substr(first));
+        if (tokens.empty()) continue;
+
+        if (!isCommandName(tokens[0])) {
+            std::cerr << script_path << ":" << line_number << ": unknown command: " << tokens[0] << std::endl;
+            return false;
+        }
+
+        commands.push_back(tokens);
+    }
+
+    return true;
+}
+
+
+// Turns argv into commands. A command name (-i, -o, @i, preview, ...) starts
+// a new command and the following arguments belong to it, so both
+//   morph -i @dir @i grayscale 50% -o @out
+//   morph -i @dir "@i grayscale 50%" -o @out
+// work. An argument with spaces that starts with a command name is parsed as
+// a full command line; any other argument is kept whole, so quoted paths
+// with spaces survive.
+bool parseArguments(int argc, char* argv[], std::vector<std::vector<std::string>>& commands, bool& streaming) {
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+
+        if (argument == "--stream") {
+            streaming = true;
+            continue;
+        }
+
+        if (argument == "--quiet" || argument == "--summary" || argument == "--progress") {
+            commands.insert(commands.begin(), {"set", "report", argument.substr(2)});
+            continue;
+        }
+
+        if (argument == "--trace") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing file after --trace" << std::endl;
+                return false;
+            }
+            // After any report mode setting, so the confirmation follows that mode.
+            auto position = commands.begin();
+            while (position != commands.end() && position->size() == 3 && (*position)[1] == "report") {
+                position++;
+            }
+            commands.insert(position, {"set", "trace", std::string("@") + argv[++i]});
+            continue;
+        }
+
+        if (argument == "--script") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing file after --script" << std::endl;
+                return false;
+            }
+            if (!loadScriptFile(argv[++i], commands)) {
+                return false;
+            }
+            continue;
+        }
+
+        std::vector<std::string> tokens = parseCommand(argument);
+
+        if (tokens.size() > 1 && isCommandName(tokens[0])) {
+            commands.push_back(tokens);
+        }
+        else if (isCommandName(argument)) {
+            commands.push_back({argument});
+        }
+        else if (!commands.empty()) {
+            commands.back().push_back(argument);
+        }
+        else {
+            std::cerr << "Unexpected argument: " << argument << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+// A job can be streamed when it is settings, then inputs, then whole-batch
+// filters, then one export with clear: nothing needs the images to stay in
+// the pipeline. Fills the stream arguments, or sets reason and returns false.
+struct StreamPlan {
+    std::vector<std::vector<std::string>> settings;
+    std::vector<std::string> input_paths;
+    std::vector<FilterOp> ops;
+    std::string output_path;
+};
+
+
+bool planStream(const std::vector<std::vector<std::string>>& commands, StreamPlan& plan, std::string& reason) {
+    for (const auto& tokens : commands) {
+        std::string command = tokens[0];
+        std::transform(command.begin(), command.end(), command.begin(), ::tolower);
+
+        if (command == "exit" || command == "quit") break;
+
+        if (!plan.output_path.empty()) {
+            reason = "commands after -o";
+            return false;
+        }
+
+        if (command == "set") {
+            plan.settings.push_back(tokens);
+        }
+        else if (command == "-i") {
+            if (!plan.ops.empty()) {
+                reason = "-i after a filter";
+                return false;
+            }
+            if (tokens.size() != 2 || tokens[1][0] != '@') {
+                reason = "-i needs a single @path";
+                return false;
+            }
+            plan.input_paths.push_back(tokens[1].substr(1));
+        }
+        else if (command == "@i") {
+            if (tokens.size() < 2) {
+                reason = "@i lists images";
+                return false;
+            }
+
+            FilterOp op = makeGrayscaleOp(100.0);
+            std::string target_file;
+            std::string label;
+            if (!parseFilterOp(tokens, op, target_file, label)) {
+                reason = "invalid filter command";
+                return false;
+            }
+            if (!target_file.empty()) {
+                reason = "only filters on every image can be streamed";
+                return false;
+            }
+            plan.ops.push_back(op);
+        }
+        else if (command == "-o") {
+            for (size_t i = 1; i < tokens.size(); i++) {
+                std::string token_lower = tokens[i];
+                std::transform(token_lower.begin(), token_lower.end(), token_lower.begin(), ::tolower);
+
+                if (tokens[i][0] == '@') {
+                    plan.output_path = tokens[i].substr(1);
+                }
+                else if (token_lower != "clear") {
+                    reason = "-o must export every image with clear";
+                    return false;
+                }
+            }
+            if (plan.output_path.empty()) {
+                reason = "-o needs an @path";
+                return false;
+            }
+        }
+        else {
+            reason = command + " needs images kept in the pipeline";
+            return false;
+        }
+    }
+
+    if (plan.input_paths.empty() || plan.output_path.empty()) {
+        reason = "job needs -i and -o";
+        return false;
+    }
+    return true;
+}
+
+
+// Batch mode: the whole job is parsed before anything runs, then executed
+// without prompts. With streaming requested and a job planStream accepts,
+// files flow through one at a time instead of all being loaded first. The
+// exit status is non-zero if any command failed.
+int runBatch(Pipeline& pipeline, const std::vector<std::vector<std::string>>& commands, bool streaming) {
+    auto start_time = std::chrono::steady_clock::now();
+    size_t executed_count = 0;
+    size_t failed_count = 0;
+
+    StreamPlan plan;
+    std::string reason;
+    if (streaming && !planStream(commands, plan, reason)) {
+        std::cerr << "Cannot stream this job (" << reason << "), running it normally" << std::endl;
+        streaming = false;
+    }
+
+    if (streaming) {
+        for (const auto& tokens : plan.settings) {
+            executed_count++;
+            if (!executeCommand(pipeline, tokens)) {
+                failed_count++;
+            }
+        }
+
+        executed_count++;
+        if (!pipeline.streamImages(plan.input_paths, plan.ops, plan.output_path)) {
+            failed_count++;
+        }
+    }
+    else {
+        for (const auto& tokens : commands) {
+            std::string command = tokens[0];
+            std::transform(command.begin(), command.end(), command.begin(), ::tolower);
+
+            if (command == "exit" || command == "quit") break;
+
+            executed_count++;
+            if (!executeCommand(pipeline, tokens)) {
+                failed_count++;
+            }
+        }
+    }
+
+    displayExitSummary(pipeline);
+
+    double elapsed_seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start_time).count();
+
+    if (pipeline.getReportMode() == ReportMode::Progress) {
+        std::cout << "{\"event\":\"batch\",\"commands\":" << executed_count << ",\"failed\":" << failed_count
+                  << ",\"seconds\":" << elapsed_seconds << "}" << std::endl;
+    }
+    else if (pipeline.getReportMode() != ReportMode::Quiet) {
+        std::cout << "\nBatch finished: " << executed_count << " command(s), " << failed_count
+                  << " failed, " << elapsed_seconds << " s" << std::endl;
+    }
+
+    return (failed_count > 0) ? 1 : 0;
+}
+
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        std::string first_argument = argv[1];
+        if (first_argument == "--help" || first_argument == "-h") {
+            displayUsage();
+            displayHelp();
+            return 0;
+        }
+
+        std::vector<std::vector<std::string>> commands;
+        bool streaming = false;
+        if (!parseArguments(argc, argv, commands, streaming)) {
+            displayUsage();
+            return 2;
+        }
+
+        Pipeline pipeline;
+        return runBatch(pipeline, commands, streaming);
+    }
+
     Pipeline pipeline;
     bool running = true;
 
@@ -164,7 +968,10 @@ int main() {
     while (running) {
         std::cout << "> ";
         std::string user_input;
-        std::getline(std::cin, user_input);
+        if (!std::getline(std::cin, user_input)) {
+            displayExitSummary(pipeline);
+            break;
+        }
 
         if (user_input.empty()) continue;
 
@@ -175,33 +982,11 @@ int main() {
         std::transform(command.begin(), command.end(), command.begin(), ::tolower);
 
         if (command == "exit" || command == "quit") {
-            size_t memory_bytes = pipeline.getMemoryUsage();
-            if (memory_bytes > 0) {
-                double memory_mb = memory_bytes / (1024.0 * 1024.0);
-                std::cout << "\nClearing " << memory_mb << " MB from input..." << std::endl;
-            }
+            displayExitSummary(pipeline);
             running = false;
         }
-        else if (command == "help") {
-            displayHelp();
-        }
-        else if (command == "-i") {
-            handleInputCommand(pipeline, tokens);
-        }
-        else if (command == "@i") {
-            handleFilterCommand(pipeline, tokens);
-        }
-        else if (command == "preview") {
-            handlePreviewCommand(pipeline, tokens);
-        }
-        else if (command == "-o") {
-            handleOutputCommand(pipeline, tokens);
-        }
-        else if (command == "list") {
-            pipeline.listInput();
-        }
         else {
-            std::cerr << "Unknown command. Type 'help' for available commands." << std::endl;
+            executeCommand(pipeline, tokens);
         }
     }
 